@@ -0,0 +1,774 @@
+#ifndef NES_APU_H
+#define NES_APU_H
+
+#include <algorithm>
+#include <cstdint>
+#include "blip_buffer.h"
+#include "ram_controller.h"
+
+// The 2A03 sound hardware: two pulse channels, a triangle, noise and the
+// delta modulation channel (DMC), driven by the frame counter.
+//
+// Nothing is stepped per CPU cycle. The apu is brought up to date in blocks
+// (see apu::run_until()), and each channel then runs on its own through the
+// whole block, visiting only the cycles where its timer clocks. Changes of a
+// channel's output level go to a blip_buffer as band limited steps, which
+// resamples them to the output rate. Silent pulse and triangle channels
+// skip their timer clocks arithmetically. Noise and the DMC still visit every
+// clock of their timers while silent, as the noise shift register and the
+// DMC's sample reader step on each of them.
+//
+// Channels are mixed with the linear approximation of the console's mixer,
+// which lets every channel add its steps on its own.
+
+namespace apu_detail {
+
+constexpr std::uint8_t length_table[32] = {
+    10, 254, 20, 2,  40, 4,  80, 6,  160, 8,  60, 10, 14, 12, 26, 14,
+    12, 16,  24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30};
+
+// Changes level to new_level at time, as seen by out. weight is the share of
+// the mix that one step of the channel's level is worth.
+void set_level(blip_buffer& out,
+               std::uint32_t time,
+               std::int32_t& level,
+               std::int32_t new_level,
+               float weight) noexcept {
+  if (new_level != level) {
+    out.add_delta(time, static_cast<float>(new_level - level) * weight);
+    level = new_level;
+  }
+}
+
+// Advances a timer that clocks every period cycles by elapsed cycles.
+// remaining is the number of cycles before its next clock (0 if it clocks on
+// the first cycle). Returns the number of clocks.
+constexpr std::uint32_t skip_timer(std::uint32_t& remaining,
+                                   std::uint32_t period,
+                                   std::uint32_t elapsed) noexcept {
+  if (elapsed <= remaining) {
+    remaining -= elapsed;
+    return 0;
+  }
+  auto clocks = (elapsed - remaining - 1) / period + 1;
+  remaining = remaining + clocks * period - elapsed;
+  return clocks;
+}
+
+// Volume of the pulse and noise channels, either constant or decaying
+class envelope {
+ public:
+  constexpr void write(std::uint8_t value) noexcept {
+    m_period = value & 0x0FU;
+    m_constant = (value & 0x10U) != 0;
+    m_loop = (value & 0x20U) != 0;
+  }
+
+  constexpr void restart() noexcept { m_start = true; }
+
+  // Quarter frame
+  constexpr void clock() noexcept {
+    if (m_start) {
+      m_start = false;
+      m_decay = 15;
+      m_divider = m_period;
+    } else if (m_divider > 0) {
+      --m_divider;
+    } else {
+      m_divider = m_period;
+      if (m_decay > 0) {
+        --m_decay;
+      } else if (m_loop) {
+        m_decay = 15;
+      }
+    }
+  }
+
+  [[nodiscard]] constexpr std::int32_t volume() const noexcept {
+    return m_constant ? m_period : m_decay;
+  }
+
+  // Doubles as the length counter halt flag
+  [[nodiscard]] constexpr bool loop() const noexcept { return m_loop; }
+
+ private:
+  std::uint8_t m_period{0};
+  std::uint8_t m_divider{0};
+  std::uint8_t m_decay{0};
+  bool m_constant{false};
+  bool m_loop{false};
+  bool m_start{false};
+};
+
+class length_counter {
+ public:
+  constexpr void set_enabled(bool enabled) noexcept {
+    m_enabled = enabled;
+    if (!enabled) {
+      m_count = 0;
+    }
+  }
+
+  constexpr void load(std::uint8_t value) noexcept {
+    if (m_enabled) {
+      m_count = length_table[value >> 3U];
+    }
+  }
+
+  // Half frame
+  constexpr void clock(bool halt) noexcept {
+    if (!halt && m_count > 0) {
+      --m_count;
+    }
+  }
+
+  [[nodiscard]] constexpr bool active() const noexcept { return m_count > 0; }
+
+ private:
+  std::uint8_t m_count{0};
+  bool m_enabled{false};
+};
+
+// $4000-$4003 and $4004-$4007. The two differ only in how the sweep unit
+// negates.
+class pulse_channel {
+ public:
+  static constexpr float weight = 0.00752F;
+
+  explicit constexpr pulse_channel(bool ones_complement = false) noexcept
+      : m_ones_complement(ones_complement) {}
+
+  constexpr void write(unsigned reg, std::uint8_t value) noexcept {
+    switch (reg) {
+      case 0:
+        m_duty = value >> 6U;
+        m_envelope.write(value);
+        break;
+      case 1:
+        m_sweep = value;
+        m_sweep_reload = true;
+        break;
+      case 2:
+        m_period = static_cast<std::uint16_t>((m_period & 0x0700U) | value);
+        break;
+      default:
+        m_period = static_cast<std::uint16_t>((m_period & 0x00FFU) |
+                                              ((value & 0x07U) << 8U));
+        m_length.load(value);
+        m_step = 0;
+        m_envelope.restart();
+        break;
+    }
+  }
+
+  constexpr void clock_quarter_frame() noexcept { m_envelope.clock(); }
+
+  constexpr void clock_half_frame() noexcept {
+    m_length.clock(m_envelope.loop());
+    auto shift = m_sweep & 0x07U;
+    if (m_sweep_divider == 0 && (m_sweep & 0x80U) != 0 && shift > 0 &&
+        !muted()) {
+      m_period = static_cast<std::uint16_t>(sweep_target());
+    }
+    if (m_sweep_divider == 0 || m_sweep_reload) {
+      m_sweep_divider = (m_sweep >> 4U) & 0x07U;
+      m_sweep_reload = false;
+    } else {
+      --m_sweep_divider;
+    }
+  }
+
+  [[nodiscard]] constexpr length_counter& length() noexcept { return m_length; }
+
+  [[nodiscard]] constexpr std::int32_t output() const noexcept {
+    constexpr std::uint8_t sequences[4] = {0b00000010, 0b00000110, 0b00011110,
+                                           0b11111001};
+    if (!m_length.active() || muted() ||
+        ((sequences[m_duty] >> m_step) & 0x01U) == 0) {
+      return 0;
+    }
+    return m_envelope.volume();
+  }
+
+  // Runs the cycles from start to end (exclusive), times relative to the
+  // frame of out
+  void run(std::uint32_t start, std::uint32_t end, blip_buffer& out) noexcept {
+    // The timer clocks every other CPU cycle
+    auto period = (std::uint32_t{m_period} + 1) * 2;
+    if (!m_length.active() || muted() || m_envelope.volume() == 0) {
+      auto clocks = skip_timer(m_timer, period, end - start);
+      m_step = static_cast<std::uint8_t>((m_step - clocks) & 0x07U);
+      return;
+    }
+    auto time = start + m_timer;
+    for (; time < end; time += period) {
+      m_step = static_cast<std::uint8_t>((m_step - 1U) & 0x07U);
+      set_level(out, time, m_level, output(), weight);
+    }
+    m_timer = time - end;
+  }
+
+  [[nodiscard]] constexpr std::int32_t& level() noexcept { return m_level; }
+
+ private:
+  [[nodiscard]] constexpr unsigned sweep_target() const noexcept {
+    auto period = unsigned{m_period};
+    auto change = period >> (m_sweep & 0x07U);
+    if ((m_sweep & 0x08U) == 0) {
+      return period + change;
+    }
+    return period - change - (m_ones_complement ? 1U : 0U);
+  }
+
+  [[nodiscard]] constexpr bool muted() const noexcept {
+    return m_period < 8 || sweep_target() > 0x07FFU;
+  }
+
+  envelope m_envelope;
+  length_counter m_length;
+  std::uint16_t m_period{0};
+  std::uint32_t m_timer{0};
+  std::uint8_t m_duty{0};
+  std::uint8_t m_step{0};
+  std::uint8_t m_sweep{0};
+  std::uint8_t m_sweep_divider{0};
+  bool m_sweep_reload{false};
+  bool m_ones_complement;
+  std::int32_t m_level{0};
+};
+
+// $4008-$400B
+class triangle_channel {
+ public:
+  static constexpr float weight = 0.00851F;
+
+  constexpr void write(unsigned reg, std::uint8_t value) noexcept {
+    switch (reg) {
+      case 0:
+        m_linear_control = value;
+        break;
+      case 1:
+        break;
+      case 2:
+        m_period = static_cast<std::uint16_t>((m_period & 0x0700U) | value);
+        break;
+      default:
+        m_period = static_cast<std::uint16_t>((m_period & 0x00FFU) |
+                                              ((value & 0x07U) << 8U));
+        m_length.load(value);
+        m_linear_reload = true;
+        break;
+    }
+  }
+
+  constexpr void clock_quarter_frame() noexcept {
+    if (m_linear_reload) {
+      m_linear_counter = m_linear_control & 0x7FU;
+    } else if (m_linear_counter > 0) {
+      --m_linear_counter;
+    }
+    if ((m_linear_control & 0x80U) == 0) {
+      m_linear_reload = false;
+    }
+  }
+
+  constexpr void clock_half_frame() noexcept {
+    m_length.clock((m_linear_control & 0x80U) != 0);
+  }
+
+  [[nodiscard]] constexpr length_counter& length() noexcept { return m_length; }
+
+  // The sequencer stops where it is when the channel is silenced
+  [[nodiscard]] constexpr std::int32_t output() const noexcept {
+    return m_step < 16 ? 15 - m_step : m_step - 16;
+  }
+
+  void run(std::uint32_t start, std::uint32_t end, blip_buffer& out) noexcept {
+    // Periods below 2 are far above what anyone can hear, games use them to
+    // silence the channel. Holding the level avoids clocking every cycle.
+    if (!m_length.active() || m_linear_counter == 0 || m_period < 2) {
+      return;
+    }
+    auto period = std::uint32_t{m_period} + 1;
+    auto time = start + m_timer;
+    for (; time < end; time += period) {
+      m_step = static_cast<std::uint8_t>((m_step + 1U) & 0x1FU);
+      set_level(out, time, m_level, output(), weight);
+    }
+    m_timer = time - end;
+  }
+
+  [[nodiscard]] constexpr std::int32_t& level() noexcept { return m_level; }
+
+ private:
+  length_counter m_length;
+  std::uint16_t m_period{0};
+  std::uint32_t m_timer{0};
+  std::uint8_t m_step{0};
+  std::uint8_t m_linear_control{0};
+  std::uint8_t m_linear_counter{0};
+  bool m_linear_reload{false};
+  std::int32_t m_level{0};
+};
+
+// $400C-$400F
+class noise_channel {
+ public:
+  static constexpr float weight = 0.00494F;
+
+  constexpr void write(unsigned reg, std::uint8_t value) noexcept {
+    switch (reg) {
+      case 0:
+        m_envelope.write(value);
+        break;
+      case 1:
+        break;
+      case 2:
+        m_mode = (value & 0x80U) != 0;
+        m_period_index = value & 0x0FU;
+        break;
+      default:
+        m_length.load(value);
+        m_envelope.restart();
+        break;
+    }
+  }
+
+  constexpr void clock_quarter_frame() noexcept { m_envelope.clock(); }
+
+  constexpr void clock_half_frame() noexcept {
+    m_length.clock(m_envelope.loop());
+  }
+
+  [[nodiscard]] constexpr length_counter& length() noexcept { return m_length; }
+
+  [[nodiscard]] constexpr std::int32_t output() const noexcept {
+    if (!m_length.active() || (m_shift & 0x01U) != 0) {
+      return 0;
+    }
+    return m_envelope.volume();
+  }
+
+  void run(std::uint32_t start, std::uint32_t end, blip_buffer& out) noexcept {
+    constexpr std::uint16_t periods[16] = {4,   8,   16,  32,  64,  96,
+                                           128, 160, 202, 254, 380, 508,
+                                           762, 1016, 2034, 4068};
+    auto period = std::uint32_t{periods[m_period_index]};
+    // The shift register keeps running while the channel is silent
+    auto audible = m_length.active() && m_envelope.volume() > 0;
+    auto time = start + m_timer;
+    for (; time < end; time += period) {
+      auto feedback =
+          (m_shift ^ (m_shift >> (m_mode ? 6U : 1U))) & 0x01U;
+      m_shift = static_cast<std::uint16_t>((m_shift >> 1U) | (feedback << 14U));
+      if (audible) {
+        set_level(out, time, m_level, output(), weight);
+      }
+    }
+    m_timer = time - end;
+  }
+
+  [[nodiscard]] constexpr std::int32_t& level() noexcept { return m_level; }
+
+ private:
+  envelope m_envelope;
+  length_counter m_length;
+  std::uint16_t m_shift{1};
+  std::uint32_t m_timer{0};
+  std::uint8_t m_period_index{0};
+  bool m_mode{false};
+  std::int32_t m_level{0};
+};
+
+// $4010-$4013. Plays 1 bit deltas streamed from CPU memory.
+//
+// The CPU stalls for a few cycles on every byte fetched, which is not
+// emulated.
+class dmc_channel {
+ public:
+  static constexpr float weight = 0.00335F;
+
+  constexpr void write(unsigned reg, std::uint8_t value) noexcept {
+    switch (reg) {
+      case 0:
+        m_control = value;
+        if ((value & 0x80U) == 0) {
+          m_irq = false;
+        }
+        break;
+      case 1:
+        m_output = value & 0x7FU;
+        break;
+      case 2:
+        m_sample_address = value;
+        break;
+      default:
+        m_sample_length = value;
+        break;
+    }
+  }
+
+  // Bit 4 of $4015
+  void set_enabled(bool enabled, const ram_controller& memory) noexcept {
+    m_irq = false;
+    if (!enabled) {
+      m_bytes_remaining = 0;
+    } else if (m_bytes_remaining == 0) {
+      restart();
+      fetch(memory);
+    }
+  }
+
+  [[nodiscard]] constexpr bool active() const noexcept {
+    return m_bytes_remaining > 0;
+  }
+
+  [[nodiscard]] constexpr bool irq() const noexcept { return m_irq; }
+
+  [[nodiscard]] constexpr std::int32_t output() const noexcept {
+    return m_output;
+  }
+
+  // Number of cycles until the channel raises its IRQ, UINT32_MAX if it
+  // will not
+  [[nodiscard]] constexpr std::uint32_t cycles_until_irq() const noexcept {
+    if ((m_control & 0xC0U) != 0x80U || m_bytes_remaining == 0) {
+      return UINT32_MAX;
+    }
+    // Bytes are fetched whenever the shift register is reloaded, the IRQ
+    // comes with the fetch of the last one. The clock at m_timer is the first
+    // one run() visits, and only counts once the cycle after it is reached.
+    auto period = this->period();
+    return m_timer + (m_bits_remaining - 1U) * period +
+           (m_bytes_remaining - 1U) * 8 * period + 1;
+  }
+
+  void run(std::uint32_t start,
+           std::uint32_t end,
+           blip_buffer& out,
+           const ram_controller& memory) noexcept {
+    auto period = this->period();
+    auto time = start + m_timer;
+    for (; time < end; time += period) {
+      if (!m_silence) {
+        if ((m_shift & 0x01U) != 0) {
+          if (m_output <= 125) {
+            m_output = static_cast<std::uint8_t>(m_output + 2);
+          }
+        } else if (m_output >= 2) {
+          m_output = static_cast<std::uint8_t>(m_output - 2);
+        }
+        set_level(out, time, m_level, output(), weight);
+      }
+      m_shift >>= 1U;
+      if (--m_bits_remaining == 0) {
+        m_bits_remaining = 8;
+        m_silence = !m_buffer_full;
+        m_shift = m_buffer;
+        m_buffer_full = false;
+        fetch(memory);
+      }
+    }
+    m_timer = time - end;
+  }
+
+  [[nodiscard]] constexpr std::int32_t& level() noexcept { return m_level; }
+
+ private:
+  [[nodiscard]] constexpr std::uint32_t period() const noexcept {
+    constexpr std::uint16_t periods[16] = {428, 380, 340, 320, 286, 254,
+                                           226, 214, 190, 160, 142, 128,
+                                           106, 84,  72,  54};
+    return periods[m_control & 0x0FU];
+  }
+
+  constexpr void restart() noexcept {
+    m_address = static_cast<std::uint16_t>(0xC000U | (m_sample_address << 6U));
+    m_bytes_remaining = static_cast<std::uint16_t>((m_sample_length << 4U) + 1);
+  }
+
+  // Refills the sample buffer if it is empty and there is more to play
+  void fetch(const ram_controller& memory) noexcept {
+    if (m_buffer_full || m_bytes_remaining == 0) {
+      return;
+    }
+    m_buffer = memory.read8(m_address);
+    m_buffer_full = true;
+    m_address = static_cast<std::uint16_t>(
+        m_address == 0xFFFFU ? 0x8000U : m_address + 1U);
+    if (--m_bytes_remaining == 0) {
+      if ((m_control & 0x40U) != 0) {
+        restart();
+      } else if ((m_control & 0x80U) != 0) {
+        m_irq = true;
+      }
+    }
+  }
+
+  std::uint8_t m_control{0};
+  std::uint8_t m_sample_address{0};
+  std::uint8_t m_sample_length{0};
+  std::uint16_t m_address{0xC000};
+  std::uint16_t m_bytes_remaining{0};
+  std::uint8_t m_buffer{0};
+  bool m_buffer_full{false};
+  std::uint8_t m_shift{0};
+  std::uint8_t m_bits_remaining{8};
+  bool m_silence{true};
+  std::uint8_t m_output{0};
+  bool m_irq{false};
+  std::uint32_t m_timer{0};
+  std::int32_t m_level{0};
+};
+
+// $4017. Counts CPU cycles since it was last reset and clocks the envelopes
+// and linear counter (quarter frames), and length counters and sweep units
+// (half frames), at fixed points of its sequence.
+//
+// Writes take effect immediately instead of 3 or 4 cycles later.
+class frame_counter {
+ public:
+  struct event {
+    std::int32_t cycle;
+    bool half_frame;
+  };
+
+  // Cycles until the next quarter frame, 0 while it is due
+  [[nodiscard]] constexpr std::uint32_t cycles_until_event() const noexcept {
+    return static_cast<std::uint32_t>(sequence()[m_step].cycle - m_cycle);
+  }
+
+  // Cycles until the frame IRQ flag is set, UINT32_MAX if it will not be
+  [[nodiscard]] constexpr std::uint32_t cycles_until_irq() const noexcept {
+    if (m_five_step || m_irq_inhibit || m_irq) {
+      return UINT32_MAX;
+    }
+    return static_cast<std::uint32_t>(sequence()[3].cycle - m_cycle);
+  }
+
+  constexpr void advance(std::uint32_t cycles) noexcept {
+    m_cycle += static_cast<std::int32_t>(cycles);
+  }
+
+  // Moves past the event that is due now, returns whether it was a half
+  // frame too
+  constexpr bool take_event() noexcept {
+    auto half_frame = sequence()[m_step].half_frame;
+    if (m_step == 3) {
+      if (!m_five_step && !m_irq_inhibit) {
+        m_irq = true;
+      }
+      // The sequence restarts one cycle after the last event
+      m_cycle = -1;
+      m_step = 0;
+    } else {
+      ++m_step;
+    }
+    return half_frame;
+  }
+
+  // Returns true if the write clocks a half (and quarter) frame right away
+  constexpr bool write(std::uint8_t value) noexcept {
+    m_five_step = (value & 0x80U) != 0;
+    m_irq_inhibit = (value & 0x40U) != 0;
+    if (m_irq_inhibit) {
+      m_irq = false;
+    }
+    m_cycle = 0;
+    m_step = 0;
+    return m_five_step;
+  }
+
+  [[nodiscard]] constexpr bool irq() const noexcept { return m_irq; }
+
+  constexpr void acknowledge_irq() noexcept { m_irq = false; }
+
+ private:
+  static constexpr event four_step[4] = {
+      {7457, false}, {14913, true}, {22371, false}, {29829, true}};
+  static constexpr event five_step[4] = {
+      {7457, false}, {14913, true}, {22371, false}, {37281, true}};
+
+  [[nodiscard]] constexpr const event* sequence() const noexcept {
+    return m_five_step ? five_step : four_step;
+  }
+
+  std::int32_t m_cycle{0};
+  std::uint8_t m_step{0};
+  bool m_five_step{false};
+  bool m_irq_inhibit{false};
+  bool m_irq{false};
+};
+
+}  // namespace apu_detail
+
+// Everything needed to resume an apu where it left off, see save_state.h.
+// The samples that were not read yet are output only and not part of it.
+struct apu_state {
+  apu_detail::pulse_channel pulse[2];
+  apu_detail::triangle_channel triangle;
+  apu_detail::noise_channel noise;
+  apu_detail::dmc_channel dmc;
+  apu_detail::frame_counter frame_counter;
+  std::uint64_t cycle;
+};
+
+class apu {
+ public:
+  static constexpr double cpu_clock_rate = 1789773.0;
+  static constexpr double sample_rate = 48000.0;
+
+  // The DMC reads its samples from memory
+  explicit apu(const ram_controller& memory)
+      : m_memory(memory),
+        m_samples(cpu_clock_rate, sample_rate,
+                  static_cast<std::size_t>(sample_rate) / 4) {}
+
+  // Silences all channels and starts over at CPU cycle cycle
+  void reset(std::uint64_t cycle) noexcept {
+    m_state = power_on_state(cycle);
+    m_frame_start = cycle;
+    m_samples.clear();
+  }
+
+  // Brings the apu up to CPU cycle cycle, in one block per stretch between
+  // frame counter events
+  void run_until(std::uint64_t cycle) noexcept {
+    while (m_state.cycle < cycle) {
+      auto end = std::min(
+          cycle, m_state.cycle + m_state.frame_counter.cycles_until_event());
+      auto from = static_cast<std::uint32_t>(m_state.cycle - m_frame_start);
+      auto to = static_cast<std::uint32_t>(end - m_frame_start);
+      m_state.pulse[0].run(from, to, m_samples);
+      m_state.pulse[1].run(from, to, m_samples);
+      m_state.triangle.run(from, to, m_samples);
+      m_state.noise.run(from, to, m_samples);
+      m_state.dmc.run(from, to, m_samples, m_memory);
+      m_state.frame_counter.advance(to - from);
+      m_state.cycle = end;
+      if (m_state.frame_counter.cycles_until_event() == 0) {
+        clock_frame(m_state.frame_counter.take_event());
+      }
+    }
+    m_samples.end_frame(
+        static_cast<std::uint32_t>(m_state.cycle - m_frame_start));
+    m_frame_start = m_state.cycle;
+  }
+
+  // CPU access to $4015, the only readable register. The apu must be up to
+  // date.
+  [[nodiscard]] std::uint8_t read_status() noexcept {
+    auto status = static_cast<std::uint8_t>(
+        (m_state.pulse[0].length().active() ? 0x01U : 0U) |
+        (m_state.pulse[1].length().active() ? 0x02U : 0U) |
+        (m_state.triangle.length().active() ? 0x04U : 0U) |
+        (m_state.noise.length().active() ? 0x08U : 0U) |
+        (m_state.dmc.active() ? 0x10U : 0U) |
+        (m_state.frame_counter.irq() ? 0x40U : 0U) |
+        (m_state.dmc.irq() ? 0x80U : 0U));
+    m_state.frame_counter.acknowledge_irq();
+    return status;
+  }
+
+  // CPU access to $4000-$4013, $4015 and $4017. The apu must be up to date.
+  void write_register(std::uint16_t address, std::uint8_t value) noexcept {
+    auto reg = address & 0x03U;
+    if (address < 0x4004) {
+      m_state.pulse[0].write(reg, value);
+    } else if (address < 0x4008) {
+      m_state.pulse[1].write(reg, value);
+    } else if (address < 0x400C) {
+      m_state.triangle.write(reg, value);
+    } else if (address < 0x4010) {
+      m_state.noise.write(reg, value);
+    } else if (address < 0x4014) {
+      m_state.dmc.write(reg, value);
+    } else if (address == 0x4015) {
+      m_state.pulse[0].length().set_enabled((value & 0x01U) != 0);
+      m_state.pulse[1].length().set_enabled((value & 0x02U) != 0);
+      m_state.triangle.length().set_enabled((value & 0x04U) != 0);
+      m_state.noise.length().set_enabled((value & 0x08U) != 0);
+      m_state.dmc.set_enabled((value & 0x10U) != 0, m_memory);
+    } else if (address == 0x4017) {
+      if (m_state.frame_counter.write(value)) {
+        clock_frame(true);
+      }
+    }
+    update_levels();
+  }
+
+  // Whether the frame counter or the DMC holds the IRQ line
+  [[nodiscard]] constexpr bool irq() const noexcept {
+    return m_state.frame_counter.irq() || m_state.dmc.irq();
+  }
+
+  // First CPU cycle at which the apu may raise an IRQ, UINT64_MAX if it will
+  // not. Never later than the actual one.
+  [[nodiscard]] constexpr std::uint64_t cycle_of_next_irq() const noexcept {
+    auto cycles = std::min(m_state.frame_counter.cycles_until_irq(),
+                           m_state.dmc.cycles_until_irq());
+    return cycles == UINT32_MAX ? UINT64_MAX : m_state.cycle + cycles;
+  }
+
+  // 16 bit mono samples at sample_rate, read them with read_samples(). Up to
+  // a quarter second is buffered.
+  [[nodiscard]] constexpr blip_buffer& samples() noexcept { return m_samples; }
+
+  void save(apu_state& state) const noexcept { state = m_state; }
+
+  void load(const apu_state& state) noexcept {
+    m_state = state;
+    m_frame_start = m_state.cycle;
+  }
+
+ private:
+  [[nodiscard]] static constexpr apu_state power_on_state(
+      std::uint64_t cycle) noexcept {
+    // Only the first pulse channel negates in ones' complement
+    return apu_state{{apu_detail::pulse_channel{true},
+                      apu_detail::pulse_channel{false}},
+                     {},
+                     {},
+                     {},
+                     {},
+                     cycle};
+  }
+
+  void clock_frame(bool half_frame) noexcept {
+    m_state.pulse[0].clock_quarter_frame();
+    m_state.pulse[1].clock_quarter_frame();
+    m_state.triangle.clock_quarter_frame();
+    m_state.noise.clock_quarter_frame();
+    if (half_frame) {
+      m_state.pulse[0].clock_half_frame();
+      m_state.pulse[1].clock_half_frame();
+      m_state.triangle.clock_half_frame();
+      m_state.noise.clock_half_frame();
+    }
+    update_levels();
+  }
+
+  // Outputs level changes made by anything but the channel timers
+  void update_levels() noexcept {
+    using namespace apu_detail;
+    auto time = static_cast<std::uint32_t>(m_state.cycle - m_frame_start);
+    for (auto& pulse : m_state.pulse) {
+      set_level(m_samples, time, pulse.level(), pulse.output(),
+                pulse_channel::weight);
+    }
+    set_level(m_samples, time, m_state.triangle.level(),
+              m_state.triangle.output(), triangle_channel::weight);
+    set_level(m_samples, time, m_state.noise.level(), m_state.noise.output(),
+              noise_channel::weight);
+    set_level(m_samples, time, m_state.dmc.level(), m_state.dmc.output(),
+              dmc_channel::weight);
+  }
+
+  const ram_controller& m_memory;
+  apu_state m_state{power_on_state(0)};
+  // CPU cycle at which the current frame of m_samples started
+  std::uint64_t m_frame_start{0};
+  blip_buffer m_samples;
+};
+
+#endif  // NES_APU_H
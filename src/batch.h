@@ -0,0 +1,108 @@
+#ifndef NES_BATCH_H
+#define NES_BATCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "cartridge.h"
+#include "hash.h"
+#include "input_script.h"
+#include "job_pool.h"
+#include "recompiled.h"
+#include "scheduler.h"
+
+// Running consoles without any video or audio output, one at a time or many
+// in parallel.
+
+struct run_limits {
+  std::uint64_t frames{UINT64_MAX};
+  std::uint64_t cycles{UINT64_MAX};
+};
+
+struct run_result {
+  std::uint64_t ram_hash;
+  std::uint64_t framebuffer_hash;
+  std::uint64_t audio_hash;
+  std::uint64_t frames;
+  std::uint64_t cycles;
+  double seconds;
+  // Whether recompiled code ran, see run_instance()
+  bool recompiled;
+};
+
+// Resets nes (a scheduler) and runs it until either of the limits is
+// reached
+template <typename Console>
+[[nodiscard]] run_result run_console(Console& nes,
+                                     input_script input,
+                                     const run_limits& limits) {
+  nes.reset();
+
+  auto start = std::chrono::steady_clock::now();
+  std::uint64_t frames = 0;
+  // The audio is hashed as it is produced, a frame's worth at a time
+  auto audio_hash = fnv1a_64(byte_span{});
+  std::int16_t samples[2048];
+  while (frames < limits.frames && nes.cpu().cycles() < limits.cycles) {
+    std::uint8_t buttons[2];
+    input.buttons_for(frames, buttons);
+    nes.set_buttons(0, buttons[0]);
+    nes.set_buttons(1, buttons[1]);
+    if (nes.run_frame(limits.cycles)) {
+      ++frames;
+    }
+    while (auto count = nes.apu().samples().read_samples(samples, 2048)) {
+      audio_hash = fnv1a_64(
+          byte_span{reinterpret_cast<const std::uint8_t*>(samples),
+                    count * sizeof(samples[0])},
+          audio_hash);
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  const auto& framebuffer = nes.ppu().framebuffer();
+  return run_result{
+      fnv1a_64(nes.memory().ram()),
+      fnv1a_64(byte_span{framebuffer.data(), framebuffer.size()}), audio_hash,
+      frames, nes.cpu().cycles(), elapsed.count(), false};
+}
+
+// Runs a console from power on until either of the limits is reached.
+// The cartridge is a view of the ROM image, copying it is cheap and every
+// copy shares the same read only image. If program was recompiled from the
+// cartridge, the console runs it (see scheduler::use_recompiled()).
+[[nodiscard]] run_result run_instance(
+    cartridge cart,
+    input_script input,
+    const run_limits& limits,
+    const recompiled_program* program = nullptr) {
+  // Too large to comfortably live on the stack
+  auto nes = std::make_unique<scheduler<>>(std::move(cart));
+  auto recompiled = program != nullptr && nes->use_recompiled(*program);
+  auto result = run_console(*nes, std::move(input), limits);
+  result.recompiled = recompiled;
+  return result;
+}
+
+// Runs one independent console per input script on pool, and returns the
+// results in the same order as inputs. Every console has its own memory,
+// CPU and PPU, only the ROM image is shared.
+[[nodiscard]] std::vector<run_result> run_instances(
+    const cartridge& cart,
+    const std::vector<input_script>& inputs,
+    const run_limits& limits,
+    job_pool& pool,
+    const recompiled_program* program = nullptr) {
+  std::vector<run_result> results(inputs.size());
+  for (std::size_t i = 0; i < inputs.size(); ++i) {
+    pool.submit([&, i] {
+      results[i] = run_instance(cart, inputs[i], limits, program);
+    });
+  }
+  pool.wait();
+  return results;
+}
+
+#endif  // NES_BATCH_H
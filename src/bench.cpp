@@ -0,0 +1,202 @@
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include "opcode_table.h"
+#include "opcodes.h"
+#include "ram_controller.h"
+#include "rom_loader.h"
+#include "save_state.h"
+#include "scheduler.h"
+
+// Microbenchmarks for the CPU core, and end to end numbers for nestest.
+//
+// usage: nes_bench [google benchmark flags, e.g. --benchmark_filter=mode/]
+
+namespace {
+
+constexpr auto nestest_path = NES_ROM_DIR "/nestest.nes";
+// Where the automated nestest run ends
+constexpr std::uint64_t nestest_cycles = 26554;
+
+// Every handler and addressing mode runs on an instruction at $0200 whose
+// operands point at RAM: $0210 for absolute addressing, $10 for zero page,
+// and through $10/$11 to $0300 for the indirect modes.
+constexpr std::uint16_t instruction_address = 0x0200;
+
+struct cpu_fixture {
+  cpu_fixture(std::uint8_t opcode) {
+    memory.write8(instruction_address, opcode);
+    memory.write8(instruction_address + 1, 0x10);
+    memory.write8(instruction_address + 2, 0x02);
+    memory.write8(0x0010, 0x00);
+    memory.write8(0x0011, 0x03);
+    registers.set_x(1);
+    registers.set_y(1);
+  }
+
+  // Registers as they are right after the opcode has been fetched
+  [[nodiscard]] cpu_registers fetched() const noexcept {
+    auto result = registers;
+    result.set_pc(instruction_address + 1);
+    return result;
+  }
+
+  ram_controller memory;
+  cpu_registers registers;
+};
+
+void bench_opcode(benchmark::State& state, std::uint8_t opcode) {
+  cpu_fixture fixture{opcode};
+  auto handler = opcode::handlers[opcode];
+  for (auto _ : state) {
+    auto registers = fixture.fetched();
+    benchmark::DoNotOptimize(handler(registers, fixture.memory));
+    benchmark::DoNotOptimize(registers);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Mode>
+void bench_mode(benchmark::State& state, Mode mode) {
+  // Operands of LDA absolute, everything reads them the same way
+  cpu_fixture fixture{0xAD};
+  for (auto _ : state) {
+    auto registers = fixture.fetched();
+    benchmark::DoNotOptimize(mode(registers, fixture.memory));
+    benchmark::DoNotOptimize(registers);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+std::unique_ptr<scheduler<>> load_nestest() {
+  rom_error error{};
+  auto rom = load_rom(nestest_path, error);
+  if (!rom) {
+    return nullptr;
+  }
+  return std::make_unique<scheduler<>>(std::move(*rom));
+}
+
+// The automated nestest run from $C000, through the scheduler. Every
+// iteration restores the state from before the run, which is included in
+// the time but well below a percent of it.
+void bench_nestest(benchmark::State& state) {
+  auto nes = load_nestest();
+  if (!nes) {
+    state.SkipWithError("Unable to load " NES_ROM_DIR "/nestest.nes");
+    return;
+  }
+  nes->reset();
+  nes->cpu().m_registers.set_pc(0xC000);
+  auto start = std::make_unique<save_state>();
+  nes->save(*start);
+
+  // Number of instructions in the run, for instructions per second
+  std::uint64_t instructions = 0;
+  while (nes->cpu().cycles() < nestest_cycles) {
+    static_cast<void>(nes->cpu().process_instruction());
+    ++instructions;
+  }
+
+  for (auto _ : state) {
+    static_cast<void>(nes->load(*start));
+    nes->run_cycles(nestest_cycles);
+  }
+  state.SetItemsProcessed(
+      static_cast<std::int64_t>(instructions) * state.iterations());
+  state.counters["instructions"] = static_cast<double>(instructions);
+}
+
+// Frames of the nestest menu, which has rendering enabled
+void bench_frames(benchmark::State& state) {
+  auto nes = load_nestest();
+  if (!nes) {
+    state.SkipWithError("Unable to load " NES_ROM_DIR "/nestest.nes");
+    return;
+  }
+  nes->reset();
+  for (auto i = 0; i < 60; ++i) {
+    static_cast<void>(nes->run_frame());
+  }
+
+  for (auto _ : state) {
+    static_cast<void>(nes->run_frame());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+
+  for (auto opcode = 0U; opcode < 0x100; ++opcode) {
+    char name[16];
+    std::snprintf(name, sizeof(name), "opcode/$%02X", opcode);
+    benchmark::RegisterBenchmark(name, bench_opcode,
+                                 static_cast<std::uint8_t>(opcode));
+  }
+
+  auto register_mode = [](const char* name, auto mode) {
+    benchmark::RegisterBenchmark((std::string{"mode/"} + name).c_str(),
+                                 [mode](benchmark::State& state) {
+                                   bench_mode(state, mode);
+                                 });
+  };
+  using mem = const ram_controller;
+  register_mode("immediate", [](cpu_registers& regs, mem& m) {
+    return mode::immediate(regs, m);
+  });
+  register_mode("immediate_read", [](cpu_registers& regs, mem& m) {
+    return mode::immediate_read(regs, m);
+  });
+  register_mode("absolute", [](cpu_registers& regs, mem& m) {
+    return mode::absolute(regs, m);
+  });
+  register_mode("absolute_read", [](cpu_registers& regs, mem& m) {
+    return mode::absolute_read(regs, m);
+  });
+  register_mode("absolute_indexed", [](cpu_registers& regs, mem& m) {
+    return mode::absolute_indexed(regs, m, regs.x()).address;
+  });
+  register_mode("zero_page", [](cpu_registers& regs, mem& m) {
+    return mode::zero_page(regs, m);
+  });
+  register_mode("zero_page_read", [](cpu_registers& regs, mem& m) {
+    return mode::zero_page_read(regs, m);
+  });
+  register_mode("zero_page_x", [](cpu_registers& regs, mem& m) {
+    return mode::zero_page_x(regs, m);
+  });
+  register_mode("zero_page_x_read", [](cpu_registers& regs, mem& m) {
+    return mode::zero_page_x_read(regs, m);
+  });
+  register_mode("zero_page_y", [](cpu_registers& regs, mem& m) {
+    return mode::zero_page_y(regs, m);
+  });
+  register_mode("zero_page_y_read", [](cpu_registers& regs, mem& m) {
+    return mode::zero_page_y_read(regs, m);
+  });
+  register_mode("relative", [](cpu_registers& regs, mem& m) {
+    return mode::relative(regs, m);
+  });
+  register_mode("indirect", [](cpu_registers& regs, mem& m) {
+    return mode::indirect(regs, m);
+  });
+  register_mode("indexed_indirect", [](cpu_registers& regs, mem& m) {
+    return mode::indexed_indirect(regs, m);
+  });
+  register_mode("indirect_indexed", [](cpu_registers& regs, mem& m) {
+    return mode::indirect_indexed(regs, m).address;
+  });
+
+  benchmark::RegisterBenchmark("nestest/instructions", bench_nestest);
+  benchmark::RegisterBenchmark("nestest/frames", bench_frames);
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+}
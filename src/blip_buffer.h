@@ -0,0 +1,165 @@
+#ifndef NES_BLIP_BUFFER_H
+#define NES_BLIP_BUFFER_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Band-limited resampling of a signal made of steps, in the style of blargg's
+// blip_buf.
+//
+// Instead of being sampled at the source clock rate, the signal is described
+// by the points in time where its level changes. Each change adds a band
+// limited step (the integral of a windowed sinc, looked up for the fraction
+// of an output sample at which it happens) to the output. Producing a second
+// of audio costs as much as the number of level changes in it, plus one pass
+// over the output samples, no matter how high the source clock is.
+//
+// Times are in source clocks, relative to the start of the current frame.
+// A frame is ended with end_frame(), which makes its samples available to
+// read_samples().
+class blip_buffer {
+ public:
+  // capacity is the number of output samples that can be buffered. If they
+  // are not read in time the oldest ones are dropped.
+  blip_buffer(double clock_rate, double sample_rate, std::size_t capacity)
+      : m_factor(static_cast<std::uint64_t>(sample_rate / clock_rate *
+                                            static_cast<double>(one))),
+        m_capacity(capacity),
+        m_buffer(capacity + kernel_width) {}
+
+  // Adds a change of the level by delta at time
+  void add_delta(std::uint32_t time, float delta) noexcept {
+    auto position = m_offset + time * m_factor;
+    auto index = position >> fraction_bits;
+    if (index >= m_capacity) {
+      // Only frames far longer than the capacity get here
+      return;
+    }
+    auto phase = (position >> (fraction_bits - phase_bits)) & (phase_count - 1);
+    const auto& step = kernel()[phase];
+    auto* out = m_buffer.data() + index;
+    for (std::size_t i = 0; i < kernel_width; ++i) {
+      out[i] += step[i] * delta;
+    }
+  }
+
+  // Ends the current frame time clocks after its start, the next frame
+  // starts there
+  void end_frame(std::uint32_t time) noexcept {
+    m_offset += time * m_factor;
+    // Keep room for a whole frame after the samples that were not read
+    auto limit = m_capacity / 2;
+    if (samples_available() > limit) {
+      remove_samples(samples_available() - limit);
+    }
+  }
+
+  [[nodiscard]] std::size_t samples_available() const noexcept {
+    return m_offset >> fraction_bits;
+  }
+
+  // Reads up to count samples into out, returns how many were read
+  std::size_t read_samples(std::int16_t* out, std::size_t count) noexcept {
+    count = std::min(count, samples_available());
+    auto sum = m_sum;
+    auto dc = m_dc;
+    for (std::size_t i = 0; i < count; ++i) {
+      sum += m_buffer[i];
+      // Removes the DC offset the way the high-pass filter in the console
+      // does, roughly
+      auto sample = sum - dc;
+      dc += sample * high_pass;
+      out[i] = static_cast<std::int16_t>(
+          std::clamp(sample * 32767.0F, -32768.0F, 32767.0F));
+    }
+    m_sum = sum;
+    m_dc = dc;
+    remove_samples(count);
+    return count;
+  }
+
+  // Drops all samples and the current frame
+  void clear() noexcept {
+    m_offset = 0;
+    m_sum = 0;
+    m_dc = 0;
+    std::fill(m_buffer.begin(), m_buffer.end(), 0.0F);
+  }
+
+ private:
+  static constexpr unsigned fraction_bits = 32;
+  static constexpr std::uint64_t one = std::uint64_t{1} << fraction_bits;
+  static constexpr unsigned phase_bits = 5;
+  static constexpr std::size_t phase_count = std::size_t{1} << phase_bits;
+  static constexpr std::size_t kernel_width = 16;
+  // About 90 Hz at 48 kHz
+  static constexpr float high_pass = 0.0117F;
+
+  using kernel_type =
+      std::array<std::array<float, kernel_width>, phase_count>;
+
+  // The difference a step makes to each of the kernel_width samples from
+  // the one it happens in, for every phase (fraction of a sample) it can
+  // happen at. Summing the samples up turns that into the step.
+  [[nodiscard]] static const kernel_type& kernel() noexcept {
+    static const kernel_type table = [] {
+      constexpr double pi = 3.14159265358979323846;
+      // A little below the output Nyquist frequency
+      constexpr double cutoff = 0.9;
+      constexpr auto half = static_cast<double>(kernel_width) / 2;
+      kernel_type result{};
+      for (std::size_t phase = 0; phase < phase_count; ++phase) {
+        double taps[kernel_width];
+        double total = 0;
+        for (std::size_t i = 0; i < kernel_width; ++i) {
+          auto x = static_cast<double>(i) - (half - 1) -
+                   static_cast<double>(phase) / phase_count;
+          auto sinc =
+              x == 0 ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+          // Blackman window
+          auto window = 0.42 + 0.5 * std::cos(pi * x / half) +
+                        0.08 * std::cos(2 * pi * x / half);
+          taps[i] = sinc * window;
+          total += taps[i];
+        }
+        // Every step has to add up to exactly its delta
+        for (std::size_t i = 0; i < kernel_width; ++i) {
+          result[phase][i] = static_cast<float>(taps[i] / total);
+        }
+      }
+      return result;
+    }();
+    return table;
+  }
+
+  void remove_samples(std::size_t count) noexcept {
+    // Samples past the capacity were never stored
+    auto stored = std::min(samples_available(), m_capacity) + kernel_width;
+    auto remaining = stored > count ? stored - count : 0;
+    if (remaining > 0) {
+      std::memmove(m_buffer.data(), m_buffer.data() + count,
+                   remaining * sizeof(float));
+    }
+    std::fill(m_buffer.begin() + static_cast<std::ptrdiff_t>(remaining),
+              m_buffer.end(), 0.0F);
+    m_offset -= count * one;
+  }
+
+  // Output samples per source clock, and the position of the start of the
+  // current frame in output samples, both with fraction_bits of fraction
+  std::uint64_t m_factor;
+  std::uint64_t m_offset{0};
+  std::size_t m_capacity;
+  // Sums of the steps in each sample, kernel_width extra for the tails of
+  // steps in the last samples
+  std::vector<float> m_buffer;
+  float m_sum{0};
+  float m_dc{0};
+};
+
+#endif  // NES_BLIP_BUFFER_H
@@ -1,17 +1,58 @@
 #ifndef NES_CARTRIDGE_H
 #define NES_CARTRIDGE_H
 
+#include <memory>
+#include <utility>
 #include <vector>
+#include "common.h"
+#include "mapped_file.h"
 #include "prg_rom_bank.h"
+#include "rom_header.h"
 
+// A loaded ROM image. All data is viewed in place in the image, which is
+// shared (read only) between every copy of the cartridge.
 class cartridge {
  public:
-  explicit cartridge(std::vector<prg_rom_bank>& prg_rom)
-      : m_prg_rom(std::move(prg_rom)) {}
+  cartridge(std::shared_ptr<const mapped_file> image, const rom_header& header)
+      : m_image(std::move(image)), m_header(header) {
+    auto offset = rom_header::size;
+    if (m_header.has_trainer) {
+      m_trainer = bytes().subspan(offset, rom_header::trainer_size);
+      offset += rom_header::trainer_size;
+    }
 
-  constexpr const auto& prg_rom() const noexcept { return m_prg_rom; }
+    m_prg_rom_data = bytes().subspan(offset, m_header.prg_rom_size);
+    offset += m_header.prg_rom_size;
+    m_chr_rom = bytes().subspan(offset, m_header.chr_rom_size);
+
+    for (std::size_t bank = 0; bank < m_prg_rom_data.size();
+         bank += prg_rom_bank::size) {
+      m_prg_rom.emplace_back(m_prg_rom_data.data() + bank);
+    }
+  }
+
+  [[nodiscard]] constexpr const auto& header() const noexcept {
+    return m_header;
+  }
+  [[nodiscard]] constexpr const auto& prg_rom() const noexcept {
+    return m_prg_rom;
+  }
+  [[nodiscard]] constexpr auto prg_rom_data() const noexcept {
+    return m_prg_rom_data;
+  }
+  // Empty if the cartridge uses CHR-RAM
+  [[nodiscard]] constexpr auto chr_rom() const noexcept { return m_chr_rom; }
+  // Empty if the image has no trainer
+  [[nodiscard]] constexpr auto trainer() const noexcept { return m_trainer; }
 
  private:
+  [[nodiscard]] byte_span bytes() const noexcept { return m_image->bytes(); }
+
+  std::shared_ptr<const mapped_file> m_image;
+  rom_header m_header;
+  byte_span m_trainer;
+  byte_span m_prg_rom_data;
+  byte_span m_chr_rom;
   std::vector<prg_rom_bank> m_prg_rom;
 };
 
@@ -1,6 +1,7 @@
 #ifndef NES_COMMON_H
 #define NES_COMMON_H
 
+#include <cstddef>
 #include <cstdint>
 
 template<typename Type>
@@ -16,6 +17,34 @@ class strong_typedef{
  {
  };
 
+// Non-owning read only view of contiguous bytes (we are on C++17, so no
+// std::span)
+class byte_span {
+ public:
+  constexpr byte_span() noexcept = default;
+  constexpr byte_span(const std::uint8_t* data, std::size_t size) noexcept
+      : m_data(data), m_size(size) {}
+
+  [[nodiscard]] constexpr auto data() const noexcept { return m_data; }
+  [[nodiscard]] constexpr auto size() const noexcept { return m_size; }
+  [[nodiscard]] constexpr auto empty() const noexcept { return m_size == 0; }
+  [[nodiscard]] constexpr auto begin() const noexcept { return m_data; }
+  [[nodiscard]] constexpr auto end() const noexcept { return m_data + m_size; }
+
+  [[nodiscard]] constexpr auto operator[](std::size_t index) const noexcept {
+    return m_data[index];
+  }
+
+  [[nodiscard]] constexpr byte_span subspan(std::size_t offset,
+                                            std::size_t count) const noexcept {
+    return byte_span{m_data + offset, count};
+  }
+
+ private:
+  const std::uint8_t* m_data{nullptr};
+  std::size_t m_size{0};
+};
+
 
 
 #endif  // NES_COMMON_H
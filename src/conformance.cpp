@@ -0,0 +1,52 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include "mapped_file.h"
+#include "nestest_log.h"
+#include "rom_loader.h"
+#include "scheduler.h"
+
+// Runs nestest in automation mode (from $C000) and compares every executed
+// instruction against a golden log, either the nestest.log that comes with
+// the ROM or the output of nes_trace_render. Exits with 0 if every line of
+// the log matched, and otherwise prints the first divergence.
+//
+// usage: nes_conformance <nestest.nes> <golden log>
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " <nestest.nes> <golden log>\n";
+    return 2;
+  }
+
+  rom_error error{};
+  auto rom = load_rom(argv[1], error);
+  if (!rom) {
+    std::cerr << "Unable to load ROM: " << rom_error_message(error) << '\n';
+    return 2;
+  }
+  auto golden = mapped_file::open(argv[2]);
+  if (!golden) {
+    std::cerr << "Unable to open " << argv[2] << '\n';
+    return 2;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  // Too large to comfortably live on the stack
+  auto nes = std::make_unique<scheduler<nestest_comparator>>(
+      std::move(*rom), golden->bytes());
+  nes->reset();
+  nes->cpu().m_registers.set_pc(0xC000);
+  const auto& comparator = nes->cpu().trace();
+  // A CPU stuck in a loop would never finish the log
+  constexpr std::uint64_t cycle_limit = 10'000'000;
+  while (!comparator.finished() && nes->cpu().cycles() < cycle_limit) {
+    nes->run_cycles(1000);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  comparator.report(stdout);
+  std::printf("%.3f ms\n", elapsed.count() * 1000);
+  return comparator.finished() && !comparator.diverged() ? 0 : 1;
+}
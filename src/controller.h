@@ -0,0 +1,56 @@
+#ifndef NES_CONTROLLER_H
+#define NES_CONTROLLER_H
+
+#include <cstdint>
+
+enum class button : std::uint8_t {
+  a = 0b00000001,
+  b = 0b00000010,
+  select = 0b00000100,
+  start = 0b00001000,
+  up = 0b00010000,
+  down = 0b00100000,
+  left = 0b01000000,
+  right = 0b10000000
+};
+
+// Standard controller. While the strobe bit written to $4016 is set, the
+// buttons are continuously reloaded into a shift register that reads of
+// $4016/$4017 then shift out one button at a time, in the order of the bits
+// in button.
+class controller {
+ public:
+  // buttons is a mask of button values
+  constexpr void set_buttons(std::uint8_t buttons) noexcept {
+    m_buttons = buttons;
+    if (m_strobe) {
+      m_shift = m_buttons;
+    }
+  }
+
+  constexpr void write_strobe(std::uint8_t value) noexcept {
+    m_strobe = (value & 0x01U) != 0;
+    if (m_strobe) {
+      m_shift = m_buttons;
+    }
+  }
+
+  [[nodiscard]] constexpr std::uint8_t read() noexcept {
+    if (m_strobe) {
+      return m_buttons & 0x01U;
+    }
+    auto bit = static_cast<std::uint8_t>(m_shift & 0x01U);
+    // Official controllers return 1 once all buttons were read
+    m_shift = static_cast<std::uint8_t>((m_shift >> 1U) | 0x80U);
+    return bit;
+  }
+
+  [[nodiscard]] constexpr auto buttons() const noexcept { return m_buttons; }
+
+ private:
+  std::uint8_t m_buttons{0};
+  std::uint8_t m_shift{0};
+  bool m_strobe{false};
+};
+
+#endif  // NES_CONTROLLER_H
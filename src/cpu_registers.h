@@ -14,6 +14,19 @@ enum class cpu_flag : std::uint8_t {
   sign = 0b10000000
 };
 
+// The 6502 registers.
+//
+// N, Z, C and V are evaluated lazily. Instead of the flag bits, the registers
+// keep what the flags were derived from (the last result, the sum an addition
+// carried out of, ...), and status() and flag() work the bits out only when
+// someone looks at them. Most flag updates are overwritten by the next
+// instruction before anything reads them, so this saves the work of
+// computing them, and the branches of set_flag_if().
+//
+// The layout is meant for the interpreter: the stack pointer is a single byte
+// whose page ($01) is implied, so pushes and pulls wrap without branches, and
+// each lazily evaluated flag lives in its own field, so that updating one is
+// a plain store. Everything fits in 12 bytes.
 class cpu_registers {
  public:
   constexpr cpu_registers()
@@ -21,48 +34,64 @@ class cpu_registers {
         m_x(0),
         m_y(0),
         m_status(0b00100100),
+        m_stack(0xFD),
+        m_overflow(0),
         m_pc(0),
-        m_stack(0x01FD) {}
+        m_nz(1),
+        m_carry(0) {}
 
   [[nodiscard]] constexpr auto accumulator() const noexcept {
     return m_accumulator;
   }
   [[nodiscard]] constexpr auto x() const noexcept { return m_x; }
   [[nodiscard]] constexpr auto y() const noexcept { return m_y; }
-  [[nodiscard]] constexpr auto status() const noexcept { return m_status; }
-  [[nodiscard]] constexpr auto stack() const noexcept { return m_stack; }
+  [[nodiscard]] constexpr std::uint8_t status() const noexcept {
+    return static_cast<std::uint8_t>(
+        (m_status & ~lazy_flags) | ((m_carry >> 8U) & 0x01U) |
+        ((m_nz & 0xFFU) == 0 ? static_cast<unsigned>(cpu_flag::zero) : 0U) |
+        ((m_overflow & 0x80U) >> 1U) | ((m_nz | (m_nz >> 8U)) & 0x80U));
+  }
+  // C as 0 or 1, read straight from the lazy carry without the rest of
+  // status(), for adding it in
+  [[nodiscard]] constexpr unsigned carry() const noexcept {
+    return (m_carry >> 8U) & 0x01U;
+  }
+  // The address the stack pointer points at, $0100-$01FF
+  [[nodiscard]] constexpr std::uint16_t stack() const noexcept {
+    return static_cast<std::uint16_t>(0x0100U | m_stack);
+  }
   [[nodiscard]] constexpr auto increment_pc() noexcept { return m_pc++; }
   [[nodiscard]] constexpr auto pc() noexcept { return m_pc; }
 
-  constexpr void increment_stack() noexcept {
-    if (++m_stack > 0x01FF) {
-      m_stack = 0x0100;
-    }
-  }
-  constexpr void decrement_stack() noexcept {
-    if (m_stack == 0x0100) {
-      m_stack = 0x01FF;
-    } else {
-      --m_stack;
-    }
-  }
+  constexpr void increment_stack() noexcept { ++m_stack; }
+  constexpr void decrement_stack() noexcept { --m_stack; }
 
   constexpr void set_accumulator(std::uint8_t value) noexcept {
     m_accumulator = value;
-    set_flag_if(cpu_flag::zero, m_accumulator == 0);
-    set_flag_if(cpu_flag::sign, (m_accumulator & 0b10000000U) == 0b10000000U);
+    set_nz(value);
   }
 
   constexpr void set_x(std::uint8_t value) noexcept {
     m_x = value;
-    set_flag_if(cpu_flag::zero, m_x == 0);
-    set_flag_if(cpu_flag::sign, (m_x & 0b10000000U) == 0b10000000U);
+    set_nz(value);
   }
 
   constexpr void set_y(std::uint8_t value) noexcept {
     m_y = value;
-    set_flag_if(cpu_flag::zero, m_y == 0);
-    set_flag_if(cpu_flag::sign, (m_y & 0b10000000U) == 0b10000000U);
+    set_nz(value);
+  }
+
+  // Sets Z if value is 0 and N to bit 7 of value
+  constexpr void set_nz(std::uint8_t value) noexcept { m_nz = value; }
+
+  // Sets C to bit 8 of value, like the sum of an addition
+  constexpr void set_carry_bit8(unsigned value) noexcept {
+    m_carry = static_cast<std::uint16_t>(value);
+  }
+
+  // Sets V to bit 7 of value
+  constexpr void set_overflow_bit7(std::uint8_t value) noexcept {
+    m_overflow = value;
   }
 
   constexpr void set_pc(std::uint16_t val) noexcept { m_pc = val; }
@@ -75,37 +104,63 @@ class cpu_registers {
     return from_page != to_page;
   }
 
-  constexpr void set_stack(std::uint8_t val) noexcept {
-    m_stack = 0x0100U | val;
-  }
+  constexpr void set_stack(std::uint8_t val) noexcept { m_stack = val; }
 
   constexpr void set_status(std::uint8_t val) noexcept {
     m_status = val;
+    m_nz = static_cast<std::uint16_t>(((val & 0x80U) << 8U) |
+                                      ((val & 0x02U) == 0 ? 1U : 0U));
+    m_carry = static_cast<std::uint16_t>((val & 0x01U) << 8U);
+    m_overflow = static_cast<std::uint8_t>((val & 0x40U) << 1U);
   }
 
+  // With a constant f, only the work for that one flag is left after
+  // inlining
   [[nodiscard]] constexpr auto flag(cpu_flag f) const noexcept {
-    return (m_status & static_cast<std::uint8_t>(f)) ==
+    return (status() & static_cast<std::uint8_t>(f)) ==
            static_cast<std::uint8_t>(f);
   }
 
-  constexpr void set_flag(cpu_flag f) noexcept {
-    m_status = m_status | static_cast<std::uint8_t>(f);
-  }
+  constexpr void set_flag(cpu_flag f) noexcept { set_flag_if(f, true); }
 
   constexpr void set_flag_if(cpu_flag flag, bool set) {
-    if (set) {
-      set_flag(flag);
-    } else {
-      clear_flag(flag);
+    switch (flag) {
+      case cpu_flag::carry:
+        m_carry = set ? 0x0100U : 0U;
+        break;
+      case cpu_flag::zero:
+        // Keeps N as it is
+        m_nz = static_cast<std::uint16_t>(
+            ((m_nz & 0x8080U) != 0 ? 0x8000U : 0U) | (set ? 0U : 1U));
+        break;
+      case cpu_flag::overflow:
+        m_overflow = set ? 0x80U : 0U;
+        break;
+      case cpu_flag::sign:
+        // Keeps Z as it is
+        m_nz = static_cast<std::uint16_t>((set ? 0x8000U : 0U) |
+                                          ((m_nz & 0xFFU) == 0 ? 0U : 1U));
+        break;
+      default:
+        if (set) {
+          m_status |= static_cast<std::uint8_t>(flag);
+        } else {
+          m_status &= static_cast<std::uint8_t>(
+              ~static_cast<std::uint8_t>(flag));
+        }
+        break;
     }
   }
 
-  constexpr void clear_flag(cpu_flag f) noexcept {
-    m_status =
-        m_status & static_cast<std::uint8_t>(~static_cast<std::uint8_t>(f));
-  }
+  constexpr void clear_flag(cpu_flag f) noexcept { set_flag_if(f, false); }
 
  private:
+  static constexpr unsigned lazy_flags =
+      static_cast<unsigned>(cpu_flag::carry) |
+      static_cast<unsigned>(cpu_flag::zero) |
+      static_cast<unsigned>(cpu_flag::overflow) |
+      static_cast<unsigned>(cpu_flag::sign);
+
   std::uint8_t m_accumulator;
   std::uint8_t m_x;
   std::uint8_t m_y;
@@ -117,10 +172,22 @@ class cpu_registers {
   // 5 - Not used. Supposed to be logical 1 at all times
   // 6 - (V) Overflow flag
   // 7 - (S) Sign flag
+  // Only the bits that are not in lazy_flags are up to date.
   std::uint8_t m_status;
+  // Low byte of the stack address
+  std::uint8_t m_stack;
+  // V is bit 7
+  std::uint8_t m_overflow;
 
   std::uint16_t m_pc;
-  std::uint16_t m_stack;
+
+  // Z is set if the low byte is 0, N if bit 7 or bit 15 is set. A plain
+  // result sets both at once, and the high byte lets N and Z be set together.
+  std::uint16_t m_nz;
+  // C is bit 8
+  std::uint16_t m_carry;
 };
 
+static_assert(sizeof(cpu_registers) == 12);
+
 #endif  // NES_CPU_REGISTERS_H
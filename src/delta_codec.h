@@ -0,0 +1,61 @@
+#ifndef NES_DELTA_CODEC_H
+#define NES_DELTA_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Encodes the difference between two equally sized buffers as the XOR of
+// them, run length encoded. Consecutive emulator states mostly differ in a
+// few scattered bytes, so the XOR is almost all zero and the encoding is a
+// list of
+//
+//   <count of unchanged bytes> <count of changed bytes> <XORed bytes>
+//
+// with both counts a byte each. Applying the encoding to either buffer gives
+// the other one.
+
+// Appends the encoding of size bytes of from ^ to to out
+void encode_delta(const std::uint8_t* from,
+                  const std::uint8_t* to,
+                  std::size_t size,
+                  std::vector<std::uint8_t>& out) {
+  std::size_t i = 0;
+  while (i < size) {
+    auto unchanged_start = i;
+    while (i < size && i - unchanged_start < 0xFF && from[i] == to[i]) {
+      ++i;
+    }
+    auto changed_start = i;
+    while (i < size && i - changed_start < 0xFF && from[i] != to[i]) {
+      ++i;
+    }
+
+    out.push_back(static_cast<std::uint8_t>(changed_start - unchanged_start));
+    out.push_back(static_cast<std::uint8_t>(i - changed_start));
+    for (auto j = changed_start; j < i; ++j) {
+      out.push_back(static_cast<std::uint8_t>(from[j] ^ to[j]));
+    }
+  }
+}
+
+// XORs an encoding made by encode_delta() for size bytes into target, and
+// returns a pointer past the end of the encoding
+const std::uint8_t* apply_delta(const std::uint8_t* encoded,
+                                std::uint8_t* target,
+                                std::size_t size) noexcept {
+  std::size_t i = 0;
+  while (i < size) {
+    i += encoded[0];
+    auto changed = encoded[1];
+    encoded += 2;
+    for (std::size_t j = 0; j < changed; ++j) {
+      target[i + j] ^= encoded[j];
+    }
+    i += changed;
+    encoded += changed;
+  }
+  return encoded;
+}
+
+#endif  // NES_DELTA_CODEC_H
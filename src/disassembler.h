@@ -0,0 +1,173 @@
+#ifndef NES_DISASSEMBLER_H
+#define NES_DISASSEMBLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include "opcode_info.h"
+#include "prg_rom_bank.h"
+#include "ram_controller.h"
+
+// Turning 6502 machine code back into assembly, for the tracer, profiler and
+// anything else that shows code to people. Decoding only looks at
+// opcode_infos and never executes anything, and nothing here allocates:
+// instructions are decoded into a buffer the caller owns (and can reuse),
+// and formatted into a fixed size character array.
+
+struct disassembled_instruction {
+  std::uint16_t address;
+  std::uint8_t opcode;
+  // Only the first info().length - 1 are valid
+  std::uint8_t operands[2];
+
+  [[nodiscard]] constexpr const opcode_info& info() const noexcept {
+    return opcode_infos[opcode];
+  }
+
+  // The operand as a value or address. For branches this is the target.
+  [[nodiscard]] constexpr std::uint16_t operand() const noexcept {
+    const auto& decoded = info();
+    if (decoded.mode == addressing_mode::relative) {
+      return static_cast<std::uint16_t>(
+          address + 2 + static_cast<std::int8_t>(operands[0]));
+    }
+    if (decoded.length == 3) {
+      return static_cast<std::uint16_t>(operands[0] | operands[1] << 8U);
+    }
+    return operands[0];
+  }
+};
+
+// "LDA ($12),Y" and "JMP ($1234)" are the longest, plus the terminator
+constexpr std::size_t max_instruction_text = 12;
+
+namespace disassembler_detail {
+
+[[nodiscard]] constexpr char* write_hex(char* out,
+                                        unsigned value,
+                                        int digits) noexcept {
+  constexpr char hex[] = "0123456789ABCDEF";
+  for (auto shift = (digits - 1) * 4; shift >= 0; shift -= 4) {
+    *out++ = hex[(value >> static_cast<unsigned>(shift)) & 0x0FU];
+  }
+  return out;
+}
+
+[[nodiscard]] constexpr char* write_text(char* out, const char* text) noexcept {
+  while (*text != '\0') {
+    *out++ = *text++;
+  }
+  return out;
+}
+
+}  // namespace disassembler_detail
+
+// Writes instruction in the usual assembler syntax ("LDA $12,X") to out, NUL
+// terminated, and returns its length
+constexpr std::size_t format_instruction(
+    const disassembled_instruction& instruction,
+    char (&out)[max_instruction_text]) noexcept {
+  using namespace disassembler_detail;
+
+  const auto& info = instruction.info();
+  auto value = instruction.operand();
+  auto* it = write_text(out, info.mnemonic);
+  switch (info.mode) {
+    case addressing_mode::implied:
+      break;
+    case addressing_mode::accumulator:
+      it = write_text(it, " A");
+      break;
+    case addressing_mode::immediate:
+      it = write_hex(write_text(it, " #$"), value, 2);
+      break;
+    case addressing_mode::zero_page:
+      it = write_hex(write_text(it, " $"), value, 2);
+      break;
+    case addressing_mode::zero_page_x:
+      it = write_text(write_hex(write_text(it, " $"), value, 2), ",X");
+      break;
+    case addressing_mode::zero_page_y:
+      it = write_text(write_hex(write_text(it, " $"), value, 2), ",Y");
+      break;
+    case addressing_mode::relative:
+    case addressing_mode::absolute:
+      it = write_hex(write_text(it, " $"), value, 4);
+      break;
+    case addressing_mode::absolute_x:
+      it = write_text(write_hex(write_text(it, " $"), value, 4), ",X");
+      break;
+    case addressing_mode::absolute_y:
+      it = write_text(write_hex(write_text(it, " $"), value, 4), ",Y");
+      break;
+    case addressing_mode::indirect:
+      it = write_text(write_hex(write_text(it, " ($"), value, 4), ")");
+      break;
+    case addressing_mode::indirect_x:
+      it = write_text(write_hex(write_text(it, " ($"), value, 2), ",X)");
+      break;
+    case addressing_mode::indirect_y:
+      it = write_text(write_hex(write_text(it, " ($"), value, 2), "),Y");
+      break;
+  }
+  *it = '\0';
+  return static_cast<std::size_t>(it - out);
+}
+
+// Decodes the instructions from first up to (not including) end, one after
+// another, into out until either runs out. peek(address) returns the byte at
+// address. Returns the number of instructions decoded.
+template <typename Peek>
+std::size_t disassemble_with(Peek&& peek,
+                             std::uint16_t first,
+                             std::uint32_t end,
+                             disassembled_instruction* out,
+                             std::size_t capacity) noexcept {
+  std::size_t count = 0;
+  std::uint32_t address = first;
+  while (address < end && count < capacity) {
+    auto& instruction = out[count++];
+    instruction.address = static_cast<std::uint16_t>(address);
+    instruction.opcode = peek(instruction.address);
+    instruction.operands[0] = 0;
+    instruction.operands[1] = 0;
+    auto length = opcode_infos[instruction.opcode].length;
+    for (std::uint32_t i = 1; i < length; ++i) {
+      instruction.operands[i - 1] =
+          peek(static_cast<std::uint16_t>(address + i));
+    }
+    address += length;
+  }
+  return count;
+}
+
+// Disassembles the CPU address space from first up to end ($10000 for all
+// of it). Memory mapped registers are not read, they disassemble as $00.
+std::size_t disassemble(const ram_controller& memory,
+                        std::uint16_t first,
+                        std::uint32_t end,
+                        disassembled_instruction* out,
+                        std::size_t capacity) noexcept {
+  auto peek = [&memory](std::uint16_t address) -> std::uint8_t {
+    const auto* page =
+        memory.page_data(static_cast<std::uint8_t>(address >> 8U));
+    return page != nullptr ? page[address & 0xFFU] : 0;
+  };
+  return disassemble_with(peek, first, end, out, capacity);
+}
+
+// Disassembles bank as if mapped at bank_address ($8000 or $C000), from
+// first up to end. Operands past the end of the bank read as $00.
+std::size_t disassemble(const prg_rom_bank& bank,
+                        std::uint16_t bank_address,
+                        std::uint16_t first,
+                        std::uint32_t end,
+                        disassembled_instruction* out,
+                        std::size_t capacity) noexcept {
+  auto peek = [&bank, bank_address](std::uint16_t address) -> std::uint8_t {
+    auto offset = std::size_t{address} - std::size_t{bank_address};
+    return offset < prg_rom_bank::size ? bank.value()[offset] : 0;
+  };
+  return disassemble_with(peek, first, end, out, capacity);
+}
+
+#endif  // NES_DISASSEMBLER_H
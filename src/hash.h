@@ -0,0 +1,18 @@
+#ifndef NES_HASH_H
+#define NES_HASH_H
+
+#include <cstdint>
+#include "common.h"
+
+// 64 bit FNV-1a. Only meant for comparing emulator state between runs, not
+// for anything that needs to resist collisions on purpose.
+[[nodiscard]] constexpr std::uint64_t fnv1a_64(
+    byte_span bytes,
+    std::uint64_t hash = 0xCBF29CE484222325ULL) noexcept {
+  for (auto byte : bytes) {
+    hash = (hash ^ byte) * 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+#endif  // NES_HASH_H
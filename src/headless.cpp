@@ -0,0 +1,218 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "batch.h"
+#include "input_script.h"
+#include "job_pool.h"
+#include "mapped_file.h"
+#include "profile.h"
+#include "rom_loader.h"
+
+#ifdef NES_RECOMPILED_SOURCE
+// Written by nes_recompile, see recompiler.h
+#include NES_RECOMPILED_SOURCE
+#endif
+
+// Runs a ROM without any video or audio output for a fixed number of frames
+// and/or CPU cycles, then prints hashes of the final state and how long it
+// took. Meant for regression and fuzzing runs, where the hashes are compared
+// against those of a known good run.
+//
+// usage: nes_headless <rom> [--frames <count>] [--cycles <count>]
+//                     [--input <script>]... [--jobs <count>]
+//                     [--profile <file>] [--perf-map <file>]
+//
+// At least one of --frames and --cycles is required. See input_script.h for
+// the input script format. Every --input runs as its own console, in
+// parallel on --jobs threads (all cores by default).
+//
+// --profile and --perf-map count every executed instruction (which slows
+// the run down) and write a flat profile or perf map of the 6502 code, see
+// profile.h. They need at most one --input.
+//
+// Built with a recompiled ROM (the NES_RECOMPILE_ROM CMake option), code of
+// that ROM runs recompiled and the results say whether it did.
+
+namespace {
+
+// The program built into this binary by NES_RECOMPILE_ROM, if any
+const recompiled_program* built_in_program() {
+#ifdef NES_RECOMPILED_SOURCE
+  return &recompiled_code::program;
+#else
+  return nullptr;
+#endif
+}
+
+void print_usage(const char* program) {
+  std::cerr << "usage: " << program
+            << " <rom> [--frames <count>] [--cycles <count>]"
+               " [--input <script>]... [--jobs <count>]"
+               " [--profile <file>] [--perf-map <file>]\n";
+}
+
+bool parse_count(const char* text, std::uint64_t& count) {
+  char* end = nullptr;
+  count = std::strtoull(text, &end, 10);
+  return *text != '\0' && *end == '\0';
+}
+
+void print_result(const run_result& result) {
+  std::printf("ram_hash: %016llx\n",
+              static_cast<unsigned long long>(result.ram_hash));
+  std::printf("framebuffer_hash: %016llx\n",
+              static_cast<unsigned long long>(result.framebuffer_hash));
+  std::printf("audio_hash: %016llx\n",
+              static_cast<unsigned long long>(result.audio_hash));
+  std::printf("frames: %llu\n", static_cast<unsigned long long>(result.frames));
+  std::printf("cpu_cycles: %llu\n",
+              static_cast<unsigned long long>(result.cycles));
+  std::printf("seconds: %.6f\n", result.seconds);
+  if (result.seconds > 0) {
+    std::printf("frames_per_second: %.1f\n",
+                static_cast<double>(result.frames) / result.seconds);
+    std::printf("cpu_mhz: %.2f\n",
+                static_cast<double>(result.cycles) / result.seconds / 1e6);
+  }
+  if (built_in_program() != nullptr) {
+    std::printf("recompiled: %s\n", result.recompiled ? "yes" : "no");
+  }
+}
+
+// Runs with an instruction_profile and writes it to the requested files
+bool run_profiled(const cartridge& rom,
+                  const input_script& input,
+                  const run_limits& limits,
+                  const char* profile_path,
+                  const char* perf_map_path) {
+  auto nes = std::make_unique<scheduler<null_trace, instruction_profile>>(rom);
+  print_result(run_console(*nes, input, limits));
+
+  auto write = [&](const char* path, auto writer) {
+    if (path == nullptr) {
+      return true;
+    }
+    std::unique_ptr<std::FILE, decltype(&std::fclose)> file{
+        std::fopen(path, "w"), &std::fclose};
+    if (!file) {
+      std::cerr << "Unable to write " << path << '\n';
+      return false;
+    }
+    writer(file.get(), nes->cpu().profile());
+    return true;
+  };
+  return write(profile_path,
+               [](std::FILE* file, const instruction_profile& profile) {
+                 write_flat_profile(file, profile);
+               }) &&
+         write(perf_map_path, write_perf_map);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  run_limits limits;
+  std::uint64_t jobs = job_pool::default_thread_count();
+  std::vector<const char*> input_paths;
+  const char* profile_path = nullptr;
+  const char* perf_map_path = nullptr;
+  for (auto i = 2; i < argc; i += 2) {
+    std::string option{argv[i]};
+    if (i + 1 == argc) {
+      print_usage(argv[0]);
+      return 1;
+    }
+    auto valid = true;
+    if (option == "--frames") {
+      valid = parse_count(argv[i + 1], limits.frames);
+    } else if (option == "--cycles") {
+      valid = parse_count(argv[i + 1], limits.cycles);
+    } else if (option == "--jobs") {
+      valid = parse_count(argv[i + 1], jobs) && jobs > 0;
+    } else if (option == "--input") {
+      input_paths.push_back(argv[i + 1]);
+    } else if (option == "--profile") {
+      profile_path = argv[i + 1];
+    } else if (option == "--perf-map") {
+      perf_map_path = argv[i + 1];
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  auto profiling = profile_path != nullptr || perf_map_path != nullptr;
+  if ((limits.frames == UINT64_MAX && limits.cycles == UINT64_MAX) ||
+      (profiling && input_paths.size() > 1)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  rom_error error{};
+  auto rom = load_rom(argv[1], error);
+  if (!rom) {
+    std::cerr << "Unable to load ROM: " << rom_error_message(error) << '\n';
+    return 1;
+  }
+
+  std::vector<input_script> inputs(input_paths.empty() ? 1
+                                                       : input_paths.size());
+  for (std::size_t i = 0; i < input_paths.size(); ++i) {
+    auto file = mapped_file::open(input_paths[i]);
+    if (!file) {
+      std::cerr << "Unable to open " << input_paths[i] << '\n';
+      return 1;
+    }
+    std::size_t error_line = 0;
+    if (!inputs[i].parse(file->bytes(), error_line)) {
+      std::cerr << input_paths[i] << ':' << error_line << ": invalid input\n";
+      return 1;
+    }
+  }
+
+  if (profiling) {
+    return run_profiled(*rom, inputs.front(), limits, profile_path,
+                        perf_map_path)
+               ? 0
+               : 1;
+  }
+
+  if (inputs.size() == 1) {
+    print_result(
+        run_instance(*rom, inputs.front(), limits, built_in_program()));
+    return 0;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<run_result> results;
+  {
+    job_pool pool{jobs};
+    results = run_instances(*rom, inputs, limits, pool, built_in_program());
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::uint64_t total_frames = 0;
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    std::printf("input: %s\n", input_paths[i]);
+    print_result(results[i]);
+    std::printf("\n");
+    total_frames += results[i].frames;
+  }
+  std::printf("total_seconds: %.6f\n", elapsed.count());
+  if (elapsed.count() > 0) {
+    std::printf("total_frames_per_second: %.1f\n",
+                static_cast<double>(total_frames) / elapsed.count());
+  }
+}
@@ -0,0 +1,169 @@
+#ifndef NES_INPUT_SCRIPT_H
+#define NES_INPUT_SCRIPT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "common.h"
+#include "controller.h"
+
+// Buttons held on both controllers from frame on, until the next event
+struct input_event {
+  std::uint64_t frame;
+  std::uint8_t buttons[2];
+};
+
+// Plain text input scripts, one event per line:
+//
+//   <frame> <controller 1> [<controller 2>]
+//
+// where each controller is a set of the letters A B s (select) S (start)
+// U D L R, or a single '.' for no buttons. Frames must be increasing.
+// Empty lines and everything after a '#' are ignored. For example
+//
+//   # press start, then hold right and A
+//   60  S
+//   61  .
+//   120 RA
+class input_script {
+ public:
+  // Parses text into the script. On failure returns false with the 1-based
+  // line number of the offending line in error_line.
+  [[nodiscard]] bool parse(byte_span text, std::size_t& error_line) {
+    m_events.clear();
+    m_next = 0;
+
+    std::size_t line = 0;
+    std::size_t position = 0;
+    while (position < text.size()) {
+      ++line;
+      auto end = position;
+      while (end < text.size() && text[end] != '\n') {
+        ++end;
+      }
+      if (!parse_line(text.subspan(position, end - position))) {
+        error_line = line;
+        return false;
+      }
+      position = end + 1;
+    }
+    return true;
+  }
+
+  // Buttons to hold during the given frame, for controller 1 and 2. frame
+  // must not decrease between calls.
+  void buttons_for(std::uint64_t frame, std::uint8_t (&buttons)[2]) noexcept {
+    while (m_next < m_events.size() && m_events[m_next].frame <= frame) {
+      m_held[0] = m_events[m_next].buttons[0];
+      m_held[1] = m_events[m_next].buttons[1];
+      ++m_next;
+    }
+    buttons[0] = m_held[0];
+    buttons[1] = m_held[1];
+  }
+
+  [[nodiscard]] const auto& events() const noexcept { return m_events; }
+
+ private:
+  [[nodiscard]] static constexpr bool is_space(std::uint8_t c) noexcept {
+    return c == ' ' || c == '\t' || c == '\r';
+  }
+
+  [[nodiscard]] static constexpr std::uint8_t button_mask(
+      std::uint8_t c) noexcept {
+    switch (c) {
+      case 'A':
+        return static_cast<std::uint8_t>(button::a);
+      case 'B':
+        return static_cast<std::uint8_t>(button::b);
+      case 's':
+        return static_cast<std::uint8_t>(button::select);
+      case 'S':
+        return static_cast<std::uint8_t>(button::start);
+      case 'U':
+        return static_cast<std::uint8_t>(button::up);
+      case 'D':
+        return static_cast<std::uint8_t>(button::down);
+      case 'L':
+        return static_cast<std::uint8_t>(button::left);
+      case 'R':
+        return static_cast<std::uint8_t>(button::right);
+      default:
+        return 0;
+    }
+  }
+
+  // Splits line into whitespace separated fields, ignoring comments
+  [[nodiscard]] static std::size_t split(byte_span line,
+                                         byte_span (&fields)[4]) noexcept {
+    std::size_t count = 0;
+    std::size_t i = 0;
+    while (i < line.size() && line[i] != '#') {
+      if (is_space(line[i])) {
+        ++i;
+        continue;
+      }
+      auto start = i;
+      while (i < line.size() && !is_space(line[i]) && line[i] != '#') {
+        ++i;
+      }
+      if (count == std::size(fields)) {
+        return count + 1;
+      }
+      fields[count++] = line.subspan(start, i - start);
+    }
+    return count;
+  }
+
+  [[nodiscard]] static bool parse_buttons(byte_span field,
+                                          std::uint8_t& buttons) noexcept {
+    buttons = 0;
+    if (field.size() == 1 && field[0] == '.') {
+      return true;
+    }
+    for (auto c : field) {
+      auto mask = button_mask(c);
+      if (mask == 0) {
+        return false;
+      }
+      buttons |= mask;
+    }
+    return true;
+  }
+
+  [[nodiscard]] bool parse_line(byte_span line) {
+    byte_span fields[4];
+    auto count = split(line, fields);
+    if (count == 0) {
+      return true;
+    }
+    if (count < 2 || count > 3) {
+      return false;
+    }
+
+    input_event event{};
+    for (auto c : fields[0]) {
+      if (c < '0' || c > '9') {
+        return false;
+      }
+      event.frame = event.frame * 10 + static_cast<std::uint64_t>(c - '0');
+    }
+    if (!m_events.empty() && event.frame <= m_events.back().frame) {
+      return false;
+    }
+
+    if (!parse_buttons(fields[1], event.buttons[0]) ||
+        (count == 3 && !parse_buttons(fields[2], event.buttons[1]))) {
+      return false;
+    }
+
+    m_events.push_back(event);
+    return true;
+  }
+
+  std::vector<input_event> m_events;
+  std::size_t m_next{0};
+  std::uint8_t m_held[2]{};
+};
+
+#endif  // NES_INPUT_SCRIPT_H
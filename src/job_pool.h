@@ -0,0 +1,171 @@
+#ifndef NES_JOB_POOL_H
+#define NES_JOB_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fixed set of worker threads running jobs, with one job queue per worker.
+// Workers take jobs from the back of their own queue and, once it is empty,
+// steal from the front of the other queues, so a worker that got unlucky
+// with long running jobs does not hold up the rest.
+//
+// Jobs are expected to be coarse (a whole emulator run), so the queues are
+// plain locked deques: a lock per job is noise next to the job itself.
+class job_pool {
+ public:
+  using job = std::function<void()>;
+
+  explicit job_pool(std::size_t threads = default_thread_count()) {
+    threads = std::max<std::size_t>(threads, 1);
+    for (std::size_t i = 0; i < threads; ++i) {
+      m_queues.push_back(std::make_unique<queue>());
+    }
+    for (std::size_t i = 0; i < threads; ++i) {
+      m_threads.emplace_back([this, i] { run_worker(i); });
+    }
+  }
+
+  job_pool(const job_pool&) = delete;
+  job_pool& operator=(const job_pool&) = delete;
+
+  // Finishes all submitted jobs first
+  ~job_pool() {
+    wait();
+    {
+      std::lock_guard lock{m_mutex};
+      m_stopping = true;
+    }
+    m_work_available.notify_all();
+    for (auto& thread : m_threads) {
+      thread.join();
+    }
+  }
+
+  [[nodiscard]] static std::size_t default_thread_count() noexcept {
+    return std::max(std::thread::hardware_concurrency(), 1U);
+  }
+
+  [[nodiscard]] std::size_t size() const noexcept { return m_threads.size(); }
+
+  // Queues job to run on some worker. Jobs must not throw. Jobs submitted
+  // from inside a job go to the queue of the worker running it.
+  void submit(job work) {
+    auto index = current_worker().pool == this
+                     ? current_worker().index
+                     : m_next_queue++ % m_queues.size();
+    // Counted first, so that whoever takes the job can never see a count
+    // that does not include it yet
+    {
+      std::lock_guard lock{m_mutex};
+      ++m_queued;
+      ++m_unfinished;
+    }
+    {
+      auto& target = *m_queues[index];
+      std::lock_guard lock{target.mutex};
+      target.jobs.push_back(std::move(work));
+    }
+    m_work_available.notify_one();
+  }
+
+  // Blocks until every job submitted so far has finished. Must not be called
+  // from a job.
+  void wait() {
+    std::unique_lock lock{m_mutex};
+    m_idle.wait(lock, [this] { return m_unfinished == 0; });
+  }
+
+ private:
+  struct queue {
+    std::mutex mutex;
+    std::deque<job> jobs;
+  };
+
+  struct worker_identity {
+    const job_pool* pool{nullptr};
+    std::size_t index{0};
+  };
+
+  [[nodiscard]] static worker_identity& current_worker() noexcept {
+    thread_local worker_identity identity;
+    return identity;
+  }
+
+  [[nodiscard]] bool pop(std::size_t index, job& work) {
+    auto& own = *m_queues[index];
+    std::lock_guard lock{own.mutex};
+    if (own.jobs.empty()) {
+      return false;
+    }
+    work = std::move(own.jobs.back());
+    own.jobs.pop_back();
+    return true;
+  }
+
+  [[nodiscard]] bool steal(std::size_t thief, job& work) {
+    for (std::size_t i = 1; i < m_queues.size(); ++i) {
+      auto& victim = *m_queues[(thief + i) % m_queues.size()];
+      std::lock_guard lock{victim.mutex};
+      if (!victim.jobs.empty()) {
+        work = std::move(victim.jobs.front());
+        victim.jobs.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void run_worker(std::size_t index) {
+    current_worker() = worker_identity{this, index};
+
+    job next;
+    while (true) {
+      if (pop(index, next) || steal(index, next)) {
+        {
+          std::lock_guard lock{m_mutex};
+          --m_queued;
+        }
+        next();
+        next = nullptr;
+
+        std::lock_guard lock{m_mutex};
+        if (--m_unfinished == 0) {
+          m_idle.notify_all();
+        }
+        continue;
+      }
+
+      std::unique_lock lock{m_mutex};
+      m_work_available.wait(lock,
+                            [this] { return m_stopping || m_queued > 0; });
+      if (m_stopping && m_queued == 0) {
+        return;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<queue>> m_queues;
+  std::vector<std::thread> m_threads;
+  std::atomic<std::size_t> m_next_queue{0};
+
+  // Guards everything below
+  std::mutex m_mutex;
+  std::condition_variable m_work_available;
+  std::condition_variable m_idle;
+  // Jobs sitting in a queue
+  std::size_t m_queued{0};
+  // Jobs submitted but not finished yet
+  std::size_t m_unfinished{0};
+  bool m_stopping{false};
+};
+
+#endif  // NES_JOB_POOL_H
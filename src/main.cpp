@@ -1,40 +1,37 @@
-#include <fstream>
-#include "cpu.h"
-#include "fmt/format.h"
+#include <cstdio>
+#include <iostream>
+#include <memory>
 #include "rom_loader.h"
+#include "scheduler.h"
 
 int main() {
-  std::ifstream f{"../../roms/nestest.nes", std::ios::binary};
-
-  auto a = load_rom(f);
-
-  ram_controller ram{};
-  cpu2a03 cpu{ram};
-
-  if (a.prg_rom().size() > 1) {
-    ram.load_prg_bank1(a.prg_rom()[0]);
-    ram.load_prg_bank2(a.prg_rom()[1]);
-  } else {
-    ram.load_prg_bank1(a.prg_rom()[0]);
-    ram.load_prg_bank2(a.prg_rom()[0]);
+  rom_error error{};
+  auto a = load_rom("../../roms/nestest.nes", error);
+  if (!a) {
+    std::cerr << "Unable to load ROM: " << rom_error_message(error) << '\n';
+    return 1;
   }
 
-  cpu.reset();
-  int iterations = 0;
-  int total_cycles = 0;
-  while (true) {
-    auto regs = cpu.m_registers;
-    auto cycles = cpu.process_instruction();
-    std::cout << fmt::format(
-        "A:{:02X} X:{:02X} Y:{:02X} P:{:02X} SP: {:02X} CYC: {:>3}",
-        regs.accumulator(), regs.x(), regs.y(), regs.status(),
-        regs.stack() & 0xFFU, total_cycles);
+#ifdef NES_TRACE
+  // Flight recorder of the most recent instructions, written to
+  // nestest.trace on exit. Render it with nes_trace_render.
+  scheduler<trace_ring> nes{std::move(*a), std::size_t{0x100000}};
+#else
+  scheduler<> nes{std::move(*a)};
+#endif
 
-    total_cycles += cycles *3;
-    std::cout << std::endl;
+  nes.reset();
+  // The automated mode starts at $C000 instead of the reset vector
+  nes.cpu().m_registers.set_pc(0xC000);
+  // nestest finishes its automated run after about 26500 CPU cycles
+  nes.run_cycles(30000);
 
-    if(++iterations > 10000) {
-      break;
-    }
+#ifdef NES_TRACE
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> trace_file{
+      std::fopen("nestest.trace", "wb"), &std::fclose};
+  if (!trace_file || !nes.cpu().trace().dump(trace_file.get())) {
+    std::cerr << "Unable to write nestest.trace\n";
+    return 1;
   }
-}
\ No newline at end of file
+#endif
+}
@@ -0,0 +1,74 @@
+#ifndef NES_MAPPED_FILE_H
+#define NES_MAPPED_FILE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <memory>
+#include <new>
+#include "common.h"
+
+// A whole file mapped read only into memory
+class mapped_file {
+ public:
+  // Returns nullptr if the file can not be opened or mapped. Empty files map
+  // successfully, with empty bytes(). Throws std::bad_alloc if there is no
+  // memory left for the mapped_file itself.
+  [[nodiscard]] static std::shared_ptr<const mapped_file> open(
+      const char* path) {
+    auto fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return nullptr;
+    }
+
+    struct stat info {};
+    if (::fstat(fd, &info) != 0 || info.st_size < 0) {
+      ::close(fd);
+      return nullptr;
+    }
+
+    auto size = static_cast<std::size_t>(info.st_size);
+    void* address = nullptr;
+    if (size > 0) {
+      address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+
+    if (address == MAP_FAILED) {
+      return nullptr;
+    }
+
+    // Owned before anything else can throw, so the mapping is never leaked
+    std::unique_ptr<mapped_file> file{new (std::nothrow)
+                                          mapped_file{address, size}};
+    if (!file) {
+      ::munmap(address, size);
+      throw std::bad_alloc{};
+    }
+    return std::shared_ptr<const mapped_file>{std::move(file)};
+  }
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  ~mapped_file() {
+    if (m_address != nullptr) {
+      ::munmap(m_address, m_size);
+    }
+  }
+
+  [[nodiscard]] byte_span bytes() const noexcept {
+    return byte_span{static_cast<const std::uint8_t*>(m_address), m_size};
+  }
+
+ private:
+  mapped_file(void* address, std::size_t size) noexcept
+      : m_address(address), m_size(size) {}
+
+  void* m_address;
+  std::size_t m_size;
+};
+
+#endif  // NES_MAPPED_FILE_H
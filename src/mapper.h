@@ -0,0 +1,478 @@
+#ifndef NES_MAPPER_H
+#define NES_MAPPER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include "cartridge.h"
+#include "ppu.h"
+#include "ram_controller.h"
+#include "rom_header.h"
+#include "vram_controller.h"
+
+// Cartridge hardware deciding which PRG and CHR banks are visible where.
+//
+// Bank switches never copy anything: PRG banks are pointer updates in the
+// CPU page tables (see ram_controller::map_prg_rom) and CHR banks pointer
+// updates in the pattern table pages of the PPU (see
+// vram_controller::map_chr).
+//
+// Every mapper keeps its registers in a trivially copyable struct and
+// derives all of its mappings from that, so a save state only has to store
+// the registers and reapply them.
+
+// Registers of whatever mapper the cartridge uses, see save_state.h
+struct mapper_state {
+  std::uint8_t registers[32];
+};
+
+class mapper : public scanline_counter {
+ public:
+  mapper(const cartridge& cart, ram_controller& memory, ::ppu& video) noexcept
+      : m_prg_rom(cart.prg_rom_data()),
+        m_mirroring(cart.header().mirroring),
+        m_memory(memory),
+        m_vram(video.vram()) {}
+
+  mapper(const mapper&) = delete;
+  mapper& operator=(const mapper&) = delete;
+
+  // Puts the registers and banks into their power on state
+  virtual void reset() noexcept = 0;
+
+  // A CPU write to $8000-$FFFF
+  virtual void write(std::uint16_t address, std::uint8_t value) noexcept = 0;
+
+  void clock_scanline() noexcept override {}
+
+  // True while the mapper holds the CPU IRQ line low
+  [[nodiscard]] virtual bool irq() const noexcept { return false; }
+
+  // Number of scanline clocks until the mapper raises an IRQ, 0 if it will
+  // not raise one without a register write first
+  [[nodiscard]] virtual int scanlines_until_irq() const noexcept { return 0; }
+
+  virtual void save(mapper_state& state) const noexcept = 0;
+  virtual void load(const mapper_state& state) noexcept = 0;
+
+ protected:
+  static constexpr std::size_t prg_bank_size = 0x2000;
+
+  [[nodiscard]] std::size_t prg_banks() const noexcept {
+    return m_prg_rom.size() / prg_bank_size;
+  }
+
+  // Maps 8 KiB PRG bank number bank (modulo the number of banks) at slot,
+  // which counts 8 KiB from $8000
+  void map_prg(std::size_t slot, std::size_t bank) noexcept {
+    m_memory.map_prg_rom(
+        static_cast<std::uint16_t>(0x8000U + slot * prg_bank_size),
+        m_prg_rom.data() + (bank % prg_banks()) * prg_bank_size,
+        prg_bank_size);
+  }
+
+  void map_prg_16k(std::size_t slot, std::size_t bank) noexcept {
+    map_prg(slot * 2, bank * 2);
+    map_prg(slot * 2 + 1, bank * 2 + 1);
+  }
+
+  void map_prg_32k(std::size_t bank) noexcept {
+    for (std::size_t i = 0; i < 4; ++i) {
+      map_prg(i, bank * 4 + i);
+    }
+  }
+
+  // CHR banks in units of 1 KiB, at slots counting 1 KiB from $0000
+  void map_chr(std::size_t slot, std::size_t bank) noexcept {
+    m_vram.map_chr(slot, bank);
+  }
+
+  void map_chr_2k(std::size_t slot, std::size_t bank) noexcept {
+    for (std::size_t i = 0; i < 2; ++i) {
+      map_chr(slot * 2 + i, bank * 2 + i);
+    }
+  }
+
+  void map_chr_4k(std::size_t slot, std::size_t bank) noexcept {
+    for (std::size_t i = 0; i < 4; ++i) {
+      map_chr(slot * 4 + i, bank * 4 + i);
+    }
+  }
+
+  void map_chr_8k(std::size_t bank) noexcept {
+    map_chr_4k(0, bank * 2);
+    map_chr_4k(1, bank * 2 + 1);
+  }
+
+  // Four screen cartridges bring their own nametable memory, and no mapper
+  // can change that
+  void set_mirroring(::mirroring mode) noexcept {
+    m_vram.set_mirroring(m_mirroring == mirroring::four_screen
+                             ? mirroring::four_screen
+                             : mode);
+  }
+
+  // Mirroring as wired on the cartridge board
+  [[nodiscard]] constexpr auto board_mirroring() const noexcept {
+    return m_mirroring;
+  }
+
+  template <typename Registers>
+  static void save_registers(const Registers& registers,
+                             mapper_state& state) noexcept {
+    static_assert(std::is_trivially_copyable_v<Registers>);
+    static_assert(sizeof(Registers) <= sizeof(mapper_state::registers));
+    std::memcpy(state.registers, &registers, sizeof(Registers));
+  }
+
+  template <typename Registers>
+  static void load_registers(Registers& registers,
+                             const mapper_state& state) noexcept {
+    std::memcpy(&registers, state.registers, sizeof(Registers));
+  }
+
+ private:
+  byte_span m_prg_rom;
+  ::mirroring m_mirroring;
+  ram_controller& m_memory;
+  vram_controller& m_vram;
+};
+
+// Mapper 0: up to 32 KiB of PRG-ROM (16 KiB is mirrored) and 8 KiB of CHR
+class nrom : public mapper {
+ public:
+  using mapper::mapper;
+
+  void reset() noexcept override {
+    map_prg_32k(0);
+    map_chr_8k(0);
+    set_mirroring(board_mirroring());
+  }
+
+  void write(std::uint16_t, std::uint8_t) noexcept override {}
+
+  void save(mapper_state&) const noexcept override {}
+  void load(const mapper_state&) noexcept override { reset(); }
+};
+
+// Mapper 1: MMC1, configured through a serial shift register. The 512 KiB
+// PRG variants (SUROM and friends) and PRG-RAM disabling are not emulated.
+class mmc1 : public mapper {
+ public:
+  using mapper::mapper;
+
+  void reset() noexcept override {
+    m_registers = registers{};
+    update_banks();
+  }
+
+  void write(std::uint16_t address, std::uint8_t value) noexcept override {
+    if ((value & 0x80U) != 0) {
+      m_registers.shift = shift_empty;
+      m_registers.control |= 0x0CU;
+      update_banks();
+      return;
+    }
+
+    // The fifth write moves the marker bit out and completes the value
+    auto complete = (m_registers.shift & 0x01U) != 0;
+    m_registers.shift = static_cast<std::uint8_t>((m_registers.shift >> 1U) |
+                                                  ((value & 0x01U) << 4U));
+    if (!complete) {
+      return;
+    }
+    switch ((address >> 13U) & 0x03U) {
+      case 0:
+        m_registers.control = m_registers.shift;
+        break;
+      case 1:
+        m_registers.chr_bank0 = m_registers.shift;
+        break;
+      case 2:
+        m_registers.chr_bank1 = m_registers.shift;
+        break;
+      default:
+        m_registers.prg_bank = m_registers.shift;
+        break;
+    }
+    m_registers.shift = shift_empty;
+    update_banks();
+  }
+
+  void save(mapper_state& state) const noexcept override {
+    save_registers(m_registers, state);
+  }
+
+  void load(const mapper_state& state) noexcept override {
+    load_registers(m_registers, state);
+    update_banks();
+  }
+
+ private:
+  // A lone marker bit, shifted right with every write
+  static constexpr std::uint8_t shift_empty = 0x10;
+
+  struct registers {
+    std::uint8_t shift{shift_empty};
+    // Powers on with the last bank fixed at $C000
+    std::uint8_t control{0x0C};
+    std::uint8_t chr_bank0{0};
+    std::uint8_t chr_bank1{0};
+    std::uint8_t prg_bank{0};
+  };
+
+  void update_banks() noexcept {
+    static constexpr mirroring modes[] = {
+        mirroring::single_screen_lower, mirroring::single_screen_upper,
+        mirroring::vertical, mirroring::horizontal};
+    set_mirroring(modes[m_registers.control & 0x03U]);
+
+    auto prg = m_registers.prg_bank & 0x0FU;
+    switch ((m_registers.control >> 2U) & 0x03U) {
+      case 0:
+      case 1:
+        map_prg_32k(prg >> 1U);
+        break;
+      case 2:
+        map_prg_16k(0, 0);
+        map_prg_16k(1, prg);
+        break;
+      default:
+        map_prg_16k(0, prg);
+        map_prg_16k(1, prg_banks() / 2 - 1);
+        break;
+    }
+
+    if ((m_registers.control & 0x10U) != 0) {
+      map_chr_4k(0, m_registers.chr_bank0);
+      map_chr_4k(1, m_registers.chr_bank1);
+    } else {
+      map_chr_8k(m_registers.chr_bank0 >> 1U);
+    }
+  }
+
+  registers m_registers;
+};
+
+// Mapper 2: UxROM, a switchable 16 KiB bank at $8000 and the last one fixed
+// at $C000. Bus conflicts are not emulated.
+class uxrom : public mapper {
+ public:
+  using mapper::mapper;
+
+  void reset() noexcept override {
+    m_bank = 0;
+    map_chr_8k(0);
+    set_mirroring(board_mirroring());
+    update_banks();
+  }
+
+  void write(std::uint16_t, std::uint8_t value) noexcept override {
+    m_bank = value;
+    update_banks();
+  }
+
+  void save(mapper_state& state) const noexcept override {
+    save_registers(m_bank, state);
+  }
+
+  void load(const mapper_state& state) noexcept override {
+    reset();
+    load_registers(m_bank, state);
+    update_banks();
+  }
+
+ private:
+  void update_banks() noexcept {
+    map_prg_16k(0, m_bank);
+    map_prg_16k(1, prg_banks() / 2 - 1);
+  }
+
+  std::uint8_t m_bank{0};
+};
+
+// Mapper 3: CNROM, NROM with a switchable 8 KiB CHR bank. Bus conflicts are
+// not emulated.
+class cnrom : public mapper {
+ public:
+  using mapper::mapper;
+
+  void reset() noexcept override {
+    m_bank = 0;
+    map_prg_32k(0);
+    set_mirroring(board_mirroring());
+    map_chr_8k(m_bank);
+  }
+
+  void write(std::uint16_t, std::uint8_t value) noexcept override {
+    m_bank = value;
+    map_chr_8k(m_bank);
+  }
+
+  void save(mapper_state& state) const noexcept override {
+    save_registers(m_bank, state);
+  }
+
+  void load(const mapper_state& state) noexcept override {
+    reset();
+    load_registers(m_bank, state);
+    map_chr_8k(m_bank);
+  }
+
+ private:
+  std::uint8_t m_bank{0};
+};
+
+// Mapper 4: MMC3, with 8 KiB PRG and 1/2 KiB CHR banks and a scanline
+// counter raising IRQs. PRG-RAM protection is not emulated.
+class mmc3 : public mapper {
+ public:
+  using mapper::mapper;
+
+  void reset() noexcept override {
+    m_registers = registers{};
+    update_banks();
+  }
+
+  void write(std::uint16_t address, std::uint8_t value) noexcept override {
+    auto odd = (address & 0x0001U) != 0;
+    switch (address & 0xE000U) {
+      case 0x8000:
+        if (odd) {
+          m_registers.banks[m_registers.bank_select & 0x07U] = value;
+        } else {
+          m_registers.bank_select = value;
+        }
+        update_banks();
+        break;
+      case 0xA000:
+        if (!odd) {
+          m_registers.mirroring = value;
+          update_banks();
+        }
+        break;
+      case 0xC000:
+        if (odd) {
+          m_registers.irq_counter = 0;
+          m_registers.irq_reload = true;
+        } else {
+          m_registers.irq_latch = value;
+        }
+        break;
+      default:
+        // Disabling also acknowledges a pending IRQ
+        m_registers.irq_enabled = odd;
+        if (!odd) {
+          m_registers.irq_pending = false;
+        }
+        break;
+    }
+  }
+
+  void clock_scanline() noexcept override {
+    if (m_registers.irq_counter == 0 || m_registers.irq_reload) {
+      m_registers.irq_counter = m_registers.irq_latch;
+      m_registers.irq_reload = false;
+    } else {
+      --m_registers.irq_counter;
+    }
+    if (m_registers.irq_counter == 0 && m_registers.irq_enabled) {
+      m_registers.irq_pending = true;
+    }
+  }
+
+  [[nodiscard]] bool irq() const noexcept override {
+    return m_registers.irq_pending;
+  }
+
+  [[nodiscard]] int scanlines_until_irq() const noexcept override {
+    if (!m_registers.irq_enabled) {
+      return 0;
+    }
+    if (m_registers.irq_counter == 0 || m_registers.irq_reload) {
+      return 1 + m_registers.irq_latch;
+    }
+    return m_registers.irq_counter;
+  }
+
+  void save(mapper_state& state) const noexcept override {
+    save_registers(m_registers, state);
+  }
+
+  void load(const mapper_state& state) noexcept override {
+    load_registers(m_registers, state);
+    update_banks();
+  }
+
+ private:
+  struct registers {
+    std::uint8_t bank_select{0};
+    std::uint8_t banks[8]{0, 2, 4, 5, 6, 7, 0, 1};
+    std::uint8_t mirroring{0};
+    std::uint8_t irq_latch{0};
+    std::uint8_t irq_counter{0};
+    bool irq_reload{false};
+    bool irq_enabled{false};
+    bool irq_pending{false};
+  };
+
+  void update_banks() noexcept {
+    set_mirroring((m_registers.mirroring & 0x01U) != 0 ? mirroring::horizontal
+                                                       : mirroring::vertical);
+
+    // Bit 6 swaps the switchable bank at $8000 with the second to last one
+    // fixed at $C000
+    auto second_last = prg_banks() - 2;
+    auto swapped = (m_registers.bank_select & 0x40U) != 0;
+    map_prg(0, swapped ? second_last : m_registers.banks[6]);
+    map_prg(1, m_registers.banks[7]);
+    map_prg(2, swapped ? m_registers.banks[6] : second_last);
+    map_prg(3, prg_banks() - 1);
+
+    // Bit 7 swaps the 2 KiB banks at $0000 with the 1 KiB banks at $1000
+    auto inverted = (m_registers.bank_select & 0x80U) != 0 ? 4U : 0U;
+    map_chr_2k(inverted / 2, m_registers.banks[0] >> 1U);
+    map_chr_2k(inverted / 2 + 1, m_registers.banks[1] >> 1U);
+    for (std::size_t i = 0; i < 4; ++i) {
+      map_chr((4U - inverted) + i, m_registers.banks[2 + i]);
+    }
+  }
+
+  registers m_registers;
+};
+
+[[nodiscard]] constexpr bool is_supported_mapper(std::uint16_t number) noexcept {
+  return number <= 4;
+}
+
+// The least CHR-ROM a mapper can bank from. MMC3 switches 1 KiB banks, the
+// others switch 4 or 8 KiB and come with whole 8 KiB banks.
+[[nodiscard]] constexpr std::size_t min_chr_rom_size(
+    std::uint16_t number) noexcept {
+  return number == 4 ? 0x400 : 0x2000;
+}
+
+// The mapper for cartridge, nullptr if is_supported_mapper() is false. The
+// mapper still needs a reset() before it has mapped anything.
+[[nodiscard]] std::unique_ptr<mapper> make_mapper(const cartridge& cart,
+                                                  ram_controller& memory,
+                                                  ::ppu& video) {
+  switch (cart.header().mapper) {
+    case 0:
+      return std::make_unique<nrom>(cart, memory, video);
+    case 1:
+      return std::make_unique<mmc1>(cart, memory, video);
+    case 2:
+      return std::make_unique<uxrom>(cart, memory, video);
+    case 3:
+      return std::make_unique<cnrom>(cart, memory, video);
+    case 4:
+      return std::make_unique<mmc3>(cart, memory, video);
+    default:
+      return nullptr;
+  }
+}
+
+#endif  // NES_MAPPER_H
@@ -0,0 +1,342 @@
+#ifndef NES_NESTEST_LOG_H
+#define NES_NESTEST_LOG_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "common.h"
+#include "fmt/format.h"
+#include "trace.h"
+#include "trace_render.h"
+
+// Checking a CPU against a nestest style golden log while it runs, without
+// rendering any of its own lines.
+
+// The fields of one log line that can be compared against a trace_record
+struct nestest_line {
+  std::uint16_t pc;
+  std::uint8_t length;
+  std::uint8_t bytes[3];
+  std::uint8_t accumulator;
+  std::uint8_t x;
+  std::uint8_t y;
+  std::uint8_t status;
+  std::uint8_t stack;
+  // In CPU cycles
+  std::uint64_t cycle;
+};
+
+namespace detail {
+
+[[nodiscard]] constexpr int hex_digit(std::uint8_t c) noexcept {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// Parses exactly digits hex digits at line[offset]
+[[nodiscard]] constexpr bool parse_hex(byte_span line,
+                                       std::size_t offset,
+                                       std::size_t digits,
+                                       unsigned& value) noexcept {
+  if (offset + digits > line.size()) {
+    return false;
+  }
+  value = 0;
+  for (std::size_t i = 0; i < digits; ++i) {
+    auto digit = hex_digit(line[offset + i]);
+    if (digit < 0) {
+      return false;
+    }
+    value = value * 16 + static_cast<unsigned>(digit);
+  }
+  return true;
+}
+
+// Offset of the first character after key at or after from, or line.size()
+[[nodiscard]] constexpr std::size_t find_field(byte_span line,
+                                               std::size_t from,
+                                               const char* key) noexcept {
+  for (auto i = from; i < line.size(); ++i) {
+    std::size_t length = 0;
+    while (key[length] != '\0' && i + length < line.size() &&
+           line[i + length] == static_cast<std::uint8_t>(key[length])) {
+      ++length;
+    }
+    if (key[length] == '\0') {
+      return i + length;
+    }
+  }
+  return line.size();
+}
+
+[[nodiscard]] constexpr std::size_t skip_spaces(byte_span line,
+                                                std::size_t offset) noexcept {
+  while (offset < line.size() && line[offset] == ' ') {
+    ++offset;
+  }
+  return offset;
+}
+
+// Parses the two hex digits following key, spaces in between allowed
+[[nodiscard]] constexpr bool parse_register(byte_span line,
+                                            std::size_t& offset,
+                                            const char* key,
+                                            std::uint8_t& value) noexcept {
+  offset = skip_spaces(line, find_field(line, offset, key));
+  unsigned parsed = 0;
+  if (!parse_hex(line, offset, 2, parsed)) {
+    return false;
+  }
+  value = static_cast<std::uint8_t>(parsed);
+  offset += 2;
+  return true;
+}
+
+}  // namespace detail
+
+// Parses a line of either the current nestest.log format, where CYC counts
+// CPU cycles and a PPU field precedes it, or the format of nes_trace_render,
+// where CYC counts PPU cycles. Returns false if the line is neither.
+[[nodiscard]] constexpr bool parse_nestest_line(byte_span line,
+                                                nestest_line& out) noexcept {
+  using namespace detail;
+
+  unsigned value = 0;
+  if (!parse_hex(line, 0, 4, value)) {
+    return false;
+  }
+  out.pc = static_cast<std::uint16_t>(value);
+
+  // Instruction bytes are at columns 6, 9 and 12
+  out.length = 0;
+  while (out.length < 3 && parse_hex(line, 6 + 3U * out.length, 2, value)) {
+    out.bytes[out.length++] = static_cast<std::uint8_t>(value);
+  }
+  if (out.length == 0) {
+    return false;
+  }
+
+  // The registers follow the disassembly, which may contain "A:" and hex
+  // digits as well, but not followed by the X register
+  std::size_t offset = 6 + 3U * out.length;
+  do {
+    if (!parse_register(line, offset, "A:", out.accumulator)) {
+      return false;
+    }
+  } while (find_field(line, offset, " X:") != offset + 3);
+  if (!parse_register(line, offset, "X:", out.x) ||
+      !parse_register(line, offset, "Y:", out.y) ||
+      !parse_register(line, offset, "P:", out.status) ||
+      !parse_register(line, offset, "SP:", out.stack)) {
+    return false;
+  }
+
+  auto ppu = find_field(line, offset, "PPU:");
+  auto cycle = skip_spaces(line, find_field(line, offset, "CYC:"));
+  if (cycle == line.size()) {
+    return false;
+  }
+  out.cycle = 0;
+  for (; cycle < line.size() && line[cycle] >= '0' && line[cycle] <= '9';
+       ++cycle) {
+    out.cycle = out.cycle * 10 + static_cast<unsigned>(line[cycle] - '0');
+  }
+  if (ppu == line.size()) {
+    out.cycle /= 3;
+  }
+  return true;
+}
+
+// Trace policy comparing every executed instruction against the next line of
+// a golden log as it happens. Lines are parsed in place, nothing is rendered
+// or allocated per instruction. Cycles are compared relative to the first
+// line, so logs that count the reset sequence still match.
+//
+// Comparison stops at the first divergence or at the end of the log, and the
+// CPU may keep running after that without being checked.
+class nestest_comparator {
+ public:
+  static constexpr bool enabled = true;
+
+  // Remembers the last context instructions before a divergence, for
+  // report(). golden must outlive the comparator.
+  explicit nestest_comparator(byte_span golden, std::size_t context = 8)
+      : m_golden(golden), m_history(context) {}
+
+  void record(const trace_record& actual) noexcept {
+    if (finished()) {
+      return;
+    }
+
+    auto line = next_line();
+    if (line.empty()) {
+      m_finished = true;
+      return;
+    }
+    ++m_line_number;
+
+    nestest_line expected{};
+    if (!parse_nestest_line(line, expected)) {
+      diverge(line, actual, "line format", 0, 0);
+      return;
+    }
+    if (m_line_number == 1) {
+      m_first_cycle = expected.cycle;
+      m_first_actual_cycle = actual.cycle;
+    }
+
+    if (!compare(line, actual, expected)) {
+      return;
+    }
+
+    if (!m_history.empty()) {
+      m_history[m_matched % m_history.size()] = matched{m_line_number, line, actual};
+    }
+    ++m_matched;
+  }
+
+  // True once the log is exhausted or the CPU diverged from it
+  [[nodiscard]] bool finished() const noexcept {
+    return m_finished || m_diverged;
+  }
+
+  [[nodiscard]] bool diverged() const noexcept { return m_diverged; }
+
+  // Number of instructions that matched the log
+  [[nodiscard]] std::size_t matched_lines() const noexcept { return m_matched; }
+
+  // Describes the first divergence, preceded by the instructions leading up
+  // to it as both the log and this CPU have them
+  void report(std::FILE* file) const {
+    if (!m_diverged) {
+      std::fprintf(file, "%zu lines matched\n", m_matched);
+      return;
+    }
+
+    std::fprintf(file, "Divergence at line %zu in %s: expected %X, got %X\n",
+                 m_line_number, m_field, m_expected_value, m_actual_value);
+
+    fmt::memory_buffer out;
+    auto context = std::min(m_matched, m_history.size());
+    for (auto i = m_matched - context; i < m_matched; ++i) {
+      const auto& previous = m_history[i % m_history.size()];
+      write_pair(file, out, previous.line_number, previous.line,
+                 previous.actual);
+    }
+    write_pair(file, out, m_line_number, m_diverged_line, m_diverged_record);
+  }
+
+ private:
+  struct matched {
+    std::size_t line_number;
+    byte_span line;
+    trace_record actual;
+  };
+
+  [[nodiscard]] byte_span next_line() noexcept {
+    auto size = m_golden.size();
+    while (m_position < size) {
+      auto start = m_position;
+      while (m_position < size && m_golden[m_position] != '\n') {
+        ++m_position;
+      }
+      auto end = m_position;
+      if (m_position < size) {
+        ++m_position;
+      }
+      if (end > start && m_golden[end - 1] == '\r') {
+        --end;
+      }
+      if (end > start) {
+        return m_golden.subspan(start, end - start);
+      }
+    }
+    return byte_span{};
+  }
+
+  // Returns false, and records the divergence, at the first field that
+  // differs
+  bool compare(byte_span line,
+               const trace_record& actual,
+               const nestest_line& expected) noexcept {
+    auto check = [&](const char* field, unsigned want, unsigned got) {
+      if (want != got) {
+        diverge(line, actual, field, want, got);
+        return false;
+      }
+      return true;
+    };
+
+    if (!check("PC", expected.pc, actual.pc) ||
+        !check("opcode", expected.bytes[0], actual.opcode) ||
+        !check("length", expected.length, actual.length) ||
+        (expected.length > 1 &&
+         !check("operand", expected.bytes[1], actual.operands[0])) ||
+        (expected.length > 2 &&
+         !check("operand", expected.bytes[2], actual.operands[1])) ||
+        !check("A", expected.accumulator, actual.accumulator) ||
+        !check("X", expected.x, actual.x) ||
+        !check("Y", expected.y, actual.y) ||
+        !check("P", expected.status, actual.status) ||
+        !check("SP", expected.stack, actual.stack)) {
+      return false;
+    }
+    return check("CYC",
+                 static_cast<unsigned>(expected.cycle - m_first_cycle),
+                 static_cast<unsigned>(actual.cycle - m_first_actual_cycle));
+  }
+
+  void diverge(byte_span line,
+               const trace_record& actual,
+               const char* field,
+               unsigned expected,
+               unsigned got) noexcept {
+    m_diverged = true;
+    m_diverged_line = line;
+    m_diverged_record = actual;
+    m_field = field;
+    m_expected_value = expected;
+    m_actual_value = got;
+  }
+
+  static void write_pair(std::FILE* file,
+                         fmt::memory_buffer& out,
+                         std::size_t line_number,
+                         byte_span line,
+                         const trace_record& actual) {
+    out.clear();
+    render_nestest(actual, out);
+    std::fprintf(file, "%6zu expected %.*s\n       actual   %.*s", line_number,
+                 static_cast<int>(line.size()),
+                 reinterpret_cast<const char*>(line.data()),
+                 static_cast<int>(out.size()), out.data());
+  }
+
+  byte_span m_golden;
+  std::size_t m_position{0};
+  std::size_t m_line_number{0};
+  std::size_t m_matched{0};
+  std::uint64_t m_first_cycle{0};
+  std::uint64_t m_first_actual_cycle{0};
+  bool m_finished{false};
+  // Ring of the last matched instructions
+  std::vector<matched> m_history;
+
+  bool m_diverged{false};
+  byte_span m_diverged_line;
+  trace_record m_diverged_record{};
+  const char* m_field{""};
+  unsigned m_expected_value{0};
+  unsigned m_actual_value{0};
+};
+
+#endif  // NES_NESTEST_LOG_H
@@ -0,0 +1,329 @@
+#ifndef NES_OPCODE_INFO_H
+#define NES_OPCODE_INFO_H
+
+#include <array>
+#include <cstdint>
+
+// How an instruction finds its operand, named like the opcode:: functions
+enum class addressing_mode : std::uint8_t {
+  implied,
+  accumulator,
+  immediate,
+  zero_page,
+  zero_page_x,
+  zero_page_y,
+  relative,
+  absolute,
+  absolute_x,
+  absolute_y,
+  indirect,
+  indirect_x,
+  indirect_y,
+};
+
+// Length in bytes (opcode + operands) of an instruction with the given
+// addressing mode
+[[nodiscard]] constexpr std::uint8_t instruction_length(
+    addressing_mode mode) noexcept {
+  switch (mode) {
+    case addressing_mode::implied:
+    case addressing_mode::accumulator:
+      return 1;
+    case addressing_mode::absolute:
+    case addressing_mode::absolute_x:
+    case addressing_mode::absolute_y:
+    case addressing_mode::indirect:
+      return 3;
+    default:
+      return 2;
+  }
+}
+
+// What is known about an opcode without executing it. Decoding, tracing,
+// profiling and disassembly all look instructions up here, opcode_table.h
+// only has the implementations.
+struct opcode_info {
+  constexpr opcode_info(const char (&name)[4],
+                        addressing_mode addressing,
+                        std::uint8_t cycles,
+                        bool unofficial) noexcept
+      : mnemonic{name[0], name[1], name[2], '\0'},
+        mode(addressing),
+        length(instruction_length(addressing)),
+        base_cycles(cycles),
+        illegal(unofficial) {}
+
+  char mnemonic[4];
+  addressing_mode mode;
+  std::uint8_t length;
+  // Not counting the extra cycles for crossing a page boundary or taking a
+  // branch
+  std::uint8_t base_cycles;
+  // One of the 105 opcodes that are not part of the documented instruction
+  // set. They all execute, see opcodes.h.
+  bool illegal;
+};
+
+// Every opcode, including the unofficial ones, which use the mnemonics of
+// the opcode:: functions implementing them. nes_regression checks the
+// lengths and cycle counts against what the handlers actually do.
+constexpr std::array<opcode_info, 256> opcode_infos{{
+    {"BRK", addressing_mode::implied, 7, false},  // 0x00
+    {"ORA", addressing_mode::indirect_x, 6, false},  // 0x01
+    {"JAM", addressing_mode::implied, 2, true},  // 0x02
+    {"SLO", addressing_mode::indirect_x, 8, true},  // 0x03
+    {"NOP", addressing_mode::zero_page, 3, true},  // 0x04
+    {"ORA", addressing_mode::zero_page, 3, false},  // 0x05
+    {"ASL", addressing_mode::zero_page, 5, false},  // 0x06
+    {"SLO", addressing_mode::zero_page, 5, true},  // 0x07
+    {"PHP", addressing_mode::implied, 3, false},  // 0x08
+    {"ORA", addressing_mode::immediate, 2, false},  // 0x09
+    {"ASL", addressing_mode::accumulator, 2, false},  // 0x0A
+    {"ANC", addressing_mode::immediate, 2, true},  // 0x0B
+    {"NOP", addressing_mode::absolute, 4, true},  // 0x0C
+    {"ORA", addressing_mode::absolute, 4, false},  // 0x0D
+    {"ASL", addressing_mode::absolute, 6, false},  // 0x0E
+    {"SLO", addressing_mode::absolute, 6, true},  // 0x0F
+    {"BPL", addressing_mode::relative, 2, false},  // 0x10
+    {"ORA", addressing_mode::indirect_y, 5, false},  // 0x11
+    {"JAM", addressing_mode::implied, 2, true},  // 0x12
+    {"SLO", addressing_mode::indirect_y, 8, true},  // 0x13
+    {"NOP", addressing_mode::zero_page_x, 4, true},  // 0x14
+    {"ORA", addressing_mode::zero_page_x, 4, false},  // 0x15
+    {"ASL", addressing_mode::zero_page_x, 6, false},  // 0x16
+    {"SLO", addressing_mode::zero_page_x, 6, true},  // 0x17
+    {"CLC", addressing_mode::implied, 2, false},  // 0x18
+    {"ORA", addressing_mode::absolute_y, 4, false},  // 0x19
+    {"NOP", addressing_mode::implied, 2, true},  // 0x1A
+    {"SLO", addressing_mode::absolute_y, 7, true},  // 0x1B
+    {"NOP", addressing_mode::absolute_x, 4, true},  // 0x1C
+    {"ORA", addressing_mode::absolute_x, 4, false},  // 0x1D
+    {"ASL", addressing_mode::absolute_x, 7, false},  // 0x1E
+    {"SLO", addressing_mode::absolute_x, 7, true},  // 0x1F
+    {"JSR", addressing_mode::absolute, 6, false},  // 0x20
+    {"AND", addressing_mode::indirect_x, 6, false},  // 0x21
+    {"JAM", addressing_mode::implied, 2, true},  // 0x22
+    {"RLA", addressing_mode::indirect_x, 8, true},  // 0x23
+    {"BIT", addressing_mode::zero_page, 3, false},  // 0x24
+    {"AND", addressing_mode::zero_page, 3, false},  // 0x25
+    {"ROL", addressing_mode::zero_page, 5, false},  // 0x26
+    {"RLA", addressing_mode::zero_page, 5, true},  // 0x27
+    {"PLP", addressing_mode::implied, 4, false},  // 0x28
+    {"AND", addressing_mode::immediate, 2, false},  // 0x29
+    {"ROL", addressing_mode::accumulator, 2, false},  // 0x2A
+    {"ANC", addressing_mode::immediate, 2, true},  // 0x2B
+    {"BIT", addressing_mode::absolute, 4, false},  // 0x2C
+    {"AND", addressing_mode::absolute, 4, false},  // 0x2D
+    {"ROL", addressing_mode::absolute, 6, false},  // 0x2E
+    {"RLA", addressing_mode::absolute, 6, true},  // 0x2F
+    {"BMI", addressing_mode::relative, 2, false},  // 0x30
+    {"AND", addressing_mode::indirect_y, 5, false},  // 0x31
+    {"JAM", addressing_mode::implied, 2, true},  // 0x32
+    {"RLA", addressing_mode::indirect_y, 8, true},  // 0x33
+    {"NOP", addressing_mode::zero_page_x, 4, true},  // 0x34
+    {"AND", addressing_mode::zero_page_x, 4, false},  // 0x35
+    {"ROL", addressing_mode::zero_page_x, 6, false},  // 0x36
+    {"RLA", addressing_mode::zero_page_x, 6, true},  // 0x37
+    {"SEC", addressing_mode::implied, 2, false},  // 0x38
+    {"AND", addressing_mode::absolute_y, 4, false},  // 0x39
+    {"NOP", addressing_mode::implied, 2, true},  // 0x3A
+    {"RLA", addressing_mode::absolute_y, 7, true},  // 0x3B
+    {"NOP", addressing_mode::absolute_x, 4, true},  // 0x3C
+    {"AND", addressing_mode::absolute_x, 4, false},  // 0x3D
+    {"ROL", addressing_mode::absolute_x, 7, false},  // 0x3E
+    {"RLA", addressing_mode::absolute_x, 7, true},  // 0x3F
+    {"RTI", addressing_mode::implied, 6, false},  // 0x40
+    {"EOR", addressing_mode::indirect_x, 6, false},  // 0x41
+    {"JAM", addressing_mode::implied, 2, true},  // 0x42
+    {"SRE", addressing_mode::indirect_x, 8, true},  // 0x43
+    {"NOP", addressing_mode::zero_page, 3, true},  // 0x44
+    {"EOR", addressing_mode::zero_page, 3, false},  // 0x45
+    {"LSR", addressing_mode::zero_page, 5, false},  // 0x46
+    {"SRE", addressing_mode::zero_page, 5, true},  // 0x47
+    {"PHA", addressing_mode::implied, 3, false},  // 0x48
+    {"EOR", addressing_mode::immediate, 2, false},  // 0x49
+    {"LSR", addressing_mode::accumulator, 2, false},  // 0x4A
+    {"ALR", addressing_mode::immediate, 2, true},  // 0x4B
+    {"JMP", addressing_mode::absolute, 3, false},  // 0x4C
+    {"EOR", addressing_mode::absolute, 4, false},  // 0x4D
+    {"LSR", addressing_mode::absolute, 6, false},  // 0x4E
+    {"SRE", addressing_mode::absolute, 6, true},  // 0x4F
+    {"BVC", addressing_mode::relative, 2, false},  // 0x50
+    {"EOR", addressing_mode::indirect_y, 5, false},  // 0x51
+    {"JAM", addressing_mode::implied, 2, true},  // 0x52
+    {"SRE", addressing_mode::indirect_y, 8, true},  // 0x53
+    {"NOP", addressing_mode::zero_page_x, 4, true},  // 0x54
+    {"EOR", addressing_mode::zero_page_x, 4, false},  // 0x55
+    {"LSR", addressing_mode::zero_page_x, 6, false},  // 0x56
+    {"SRE", addressing_mode::zero_page_x, 6, true},  // 0x57
+    {"CLI", addressing_mode::implied, 2, false},  // 0x58
+    {"EOR", addressing_mode::absolute_y, 4, false},  // 0x59
+    {"NOP", addressing_mode::implied, 2, true},  // 0x5A
+    {"SRE", addressing_mode::absolute_y, 7, true},  // 0x5B
+    {"NOP", addressing_mode::absolute_x, 4, true},  // 0x5C
+    {"EOR", addressing_mode::absolute_x, 4, false},  // 0x5D
+    {"LSR", addressing_mode::absolute_x, 7, false},  // 0x5E
+    {"SRE", addressing_mode::absolute_x, 7, true},  // 0x5F
+    {"RTS", addressing_mode::implied, 6, false},  // 0x60
+    {"ADC", addressing_mode::indirect_x, 6, false},  // 0x61
+    {"JAM", addressing_mode::implied, 2, true},  // 0x62
+    {"RRA", addressing_mode::indirect_x, 8, true},  // 0x63
+    {"NOP", addressing_mode::zero_page, 3, true},  // 0x64
+    {"ADC", addressing_mode::zero_page, 3, false},  // 0x65
+    {"ROR", addressing_mode::zero_page, 5, false},  // 0x66
+    {"RRA", addressing_mode::zero_page, 5, true},  // 0x67
+    {"PLA", addressing_mode::implied, 4, false},  // 0x68
+    {"ADC", addressing_mode::immediate, 2, false},  // 0x69
+    {"ROR", addressing_mode::accumulator, 2, false},  // 0x6A
+    {"ARR", addressing_mode::immediate, 2, true},  // 0x6B
+    {"JMP", addressing_mode::indirect, 5, false},  // 0x6C
+    {"ADC", addressing_mode::absolute, 4, false},  // 0x6D
+    {"ROR", addressing_mode::absolute, 6, false},  // 0x6E
+    {"RRA", addressing_mode::absolute, 6, true},  // 0x6F
+    {"BVS", addressing_mode::relative, 2, false},  // 0x70
+    {"ADC", addressing_mode::indirect_y, 5, false},  // 0x71
+    {"JAM", addressing_mode::implied, 2, true},  // 0x72
+    {"RRA", addressing_mode::indirect_y, 8, true},  // 0x73
+    {"NOP", addressing_mode::zero_page_x, 4, true},  // 0x74
+    {"ADC", addressing_mode::zero_page_x, 4, false},  // 0x75
+    {"ROR", addressing_mode::zero_page_x, 6, false},  // 0x76
+    {"RRA", addressing_mode::zero_page_x, 6, true},  // 0x77
+    {"SEI", addressing_mode::implied, 2, false},  // 0x78
+    {"ADC", addressing_mode::absolute_y, 4, false},  // 0x79
+    {"NOP", addressing_mode::implied, 2, true},  // 0x7A
+    {"RRA", addressing_mode::absolute_y, 7, true},  // 0x7B
+    {"NOP", addressing_mode::absolute_x, 4, true},  // 0x7C
+    {"ADC", addressing_mode::absolute_x, 4, false},  // 0x7D
+    {"ROR", addressing_mode::absolute_x, 7, false},  // 0x7E
+    {"RRA", addressing_mode::absolute_x, 7, true},  // 0x7F
+    {"NOP", addressing_mode::immediate, 2, true},  // 0x80
+    {"STA", addressing_mode::indirect_x, 6, false},  // 0x81
+    {"NOP", addressing_mode::immediate, 2, true},  // 0x82
+    {"SAX", addressing_mode::indirect_x, 6, true},  // 0x83
+    {"STY", addressing_mode::zero_page, 3, false},  // 0x84
+    {"STA", addressing_mode::zero_page, 3, false},  // 0x85
+    {"STX", addressing_mode::zero_page, 3, false},  // 0x86
+    {"SAX", addressing_mode::zero_page, 3, true},  // 0x87
+    {"DEY", addressing_mode::implied, 2, false},  // 0x88
+    {"NOP", addressing_mode::immediate, 2, true},  // 0x89
+    {"TXA", addressing_mode::implied, 2, false},  // 0x8A
+    {"XAA", addressing_mode::immediate, 2, true},  // 0x8B
+    {"STY", addressing_mode::absolute, 4, false},  // 0x8C
+    {"STA", addressing_mode::absolute, 4, false},  // 0x8D
+    {"STX", addressing_mode::absolute, 4, false},  // 0x8E
+    {"SAX", addressing_mode::absolute, 4, true},  // 0x8F
+    {"BCC", addressing_mode::relative, 2, false},  // 0x90
+    {"STA", addressing_mode::indirect_y, 6, false},  // 0x91
+    {"JAM", addressing_mode::implied, 2, true},  // 0x92
+    {"AHX", addressing_mode::indirect_y, 6, true},  // 0x93
+    {"STY", addressing_mode::zero_page_x, 4, false},  // 0x94
+    {"STA", addressing_mode::zero_page_x, 4, false},  // 0x95
+    {"STX", addressing_mode::zero_page_y, 4, false},  // 0x96
+    {"SAX", addressing_mode::zero_page_y, 4, true},  // 0x97
+    {"TYA", addressing_mode::implied, 2, false},  // 0x98
+    {"STA", addressing_mode::absolute_y, 5, false},  // 0x99
+    {"TXS", addressing_mode::implied, 2, false},  // 0x9A
+    {"TAS", addressing_mode::absolute_y, 5, true},  // 0x9B
+    {"SHY", addressing_mode::absolute_x, 5, true},  // 0x9C
+    {"STA", addressing_mode::absolute_x, 5, false},  // 0x9D
+    {"SHX", addressing_mode::absolute_y, 5, true},  // 0x9E
+    {"AHX", addressing_mode::absolute_y, 5, true},  // 0x9F
+    {"LDY", addressing_mode::immediate, 2, false},  // 0xA0
+    {"LDA", addressing_mode::indirect_x, 6, false},  // 0xA1
+    {"LDX", addressing_mode::immediate, 2, false},  // 0xA2
+    {"LAX", addressing_mode::indirect_x, 6, true},  // 0xA3
+    {"LDY", addressing_mode::zero_page, 3, false},  // 0xA4
+    {"LDA", addressing_mode::zero_page, 3, false},  // 0xA5
+    {"LDX", addressing_mode::zero_page, 3, false},  // 0xA6
+    {"LAX", addressing_mode::zero_page, 3, true},  // 0xA7
+    {"TAY", addressing_mode::implied, 2, false},  // 0xA8
+    {"LDA", addressing_mode::immediate, 2, false},  // 0xA9
+    {"TAX", addressing_mode::implied, 2, false},  // 0xAA
+    {"LAX", addressing_mode::immediate, 2, true},  // 0xAB
+    {"LDY", addressing_mode::absolute, 4, false},  // 0xAC
+    {"LDA", addressing_mode::absolute, 4, false},  // 0xAD
+    {"LDX", addressing_mode::absolute, 4, false},  // 0xAE
+    {"LAX", addressing_mode::absolute, 4, true},  // 0xAF
+    {"BCS", addressing_mode::relative, 2, false},  // 0xB0
+    {"LDA", addressing_mode::indirect_y, 5, false},  // 0xB1
+    {"JAM", addressing_mode::implied, 2, true},  // 0xB2
+    {"LAX", addressing_mode::indirect_y, 5, true},  // 0xB3
+    {"LDY", addressing_mode::zero_page_x, 4, false},  // 0xB4
+    {"LDA", addressing_mode::zero_page_x, 4, false},  // 0xB5
+    {"LDX", addressing_mode::zero_page_y, 4, false},  // 0xB6
+    {"LAX", addressing_mode::zero_page_y, 4, true},  // 0xB7
+    {"CLV", addressing_mode::implied, 2, false},  // 0xB8
+    {"LDA", addressing_mode::absolute_y, 4, false},  // 0xB9
+    {"TSX", addressing_mode::implied, 2, false},  // 0xBA
+    {"LAS", addressing_mode::absolute_y, 4, true},  // 0xBB
+    {"LDY", addressing_mode::absolute_x, 4, false},  // 0xBC
+    {"LDA", addressing_mode::absolute_x, 4, false},  // 0xBD
+    {"LDX", addressing_mode::absolute_y, 4, false},  // 0xBE
+    {"LAX", addressing_mode::absolute_y, 4, true},  // 0xBF
+    {"CPY", addressing_mode::immediate, 2, false},  // 0xC0
+    {"CMP", addressing_mode::indirect_x, 6, false},  // 0xC1
+    {"NOP", addressing_mode::immediate, 2, true},  // 0xC2
+    {"DCP", addressing_mode::indirect_x, 8, true},  // 0xC3
+    {"CPY", addressing_mode::zero_page, 3, false},  // 0xC4
+    {"CMP", addressing_mode::zero_page, 3, false},  // 0xC5
+    {"DEC", addressing_mode::zero_page, 5, false},  // 0xC6
+    {"DCP", addressing_mode::zero_page, 5, true},  // 0xC7
+    {"INY", addressing_mode::implied, 2, false},  // 0xC8
+    {"CMP", addressing_mode::immediate, 2, false},  // 0xC9
+    {"DEX", addressing_mode::implied, 2, false},  // 0xCA
+    {"AXS", addressing_mode::immediate, 2, true},  // 0xCB
+    {"CPY", addressing_mode::absolute, 4, false},  // 0xCC
+    {"CMP", addressing_mode::absolute, 4, false},  // 0xCD
+    {"DEC", addressing_mode::absolute, 6, false},  // 0xCE
+    {"DCP", addressing_mode::absolute, 6, true},  // 0xCF
+    {"BNE", addressing_mode::relative, 2, false},  // 0xD0
+    {"CMP", addressing_mode::indirect_y, 5, false},  // 0xD1
+    {"JAM", addressing_mode::implied, 2, true},  // 0xD2
+    {"DCP", addressing_mode::indirect_y, 8, true},  // 0xD3
+    {"NOP", addressing_mode::zero_page_x, 4, true},  // 0xD4
+    {"CMP", addressing_mode::zero_page_x, 4, false},  // 0xD5
+    {"DEC", addressing_mode::zero_page_x, 6, false},  // 0xD6
+    {"DCP", addressing_mode::zero_page_x, 6, true},  // 0xD7
+    {"CLD", addressing_mode::implied, 2, false},  // 0xD8
+    {"CMP", addressing_mode::absolute_y, 4, false},  // 0xD9
+    {"NOP", addressing_mode::implied, 2, true},  // 0xDA
+    {"DCP", addressing_mode::absolute_y, 7, true},  // 0xDB
+    {"NOP", addressing_mode::absolute_x, 4, true},  // 0xDC
+    {"CMP", addressing_mode::absolute_x, 4, false},  // 0xDD
+    {"DEC", addressing_mode::absolute_x, 7, false},  // 0xDE
+    {"DCP", addressing_mode::absolute_x, 7, true},  // 0xDF
+    {"CPX", addressing_mode::immediate, 2, false},  // 0xE0
+    {"SBC", addressing_mode::indirect_x, 6, false},  // 0xE1
+    {"NOP", addressing_mode::immediate, 2, true},  // 0xE2
+    {"ISC", addressing_mode::indirect_x, 8, true},  // 0xE3
+    {"CPX", addressing_mode::zero_page, 3, false},  // 0xE4
+    {"SBC", addressing_mode::zero_page, 3, false},  // 0xE5
+    {"INC", addressing_mode::zero_page, 5, false},  // 0xE6
+    {"ISC", addressing_mode::zero_page, 5, true},  // 0xE7
+    {"INX", addressing_mode::implied, 2, false},  // 0xE8
+    {"SBC", addressing_mode::immediate, 2, false},  // 0xE9
+    {"NOP", addressing_mode::implied, 2, false},  // 0xEA
+    {"SBC", addressing_mode::immediate, 2, true},  // 0xEB
+    {"CPX", addressing_mode::absolute, 4, false},  // 0xEC
+    {"SBC", addressing_mode::absolute, 4, false},  // 0xED
+    {"INC", addressing_mode::absolute, 6, false},  // 0xEE
+    {"ISC", addressing_mode::absolute, 6, true},  // 0xEF
+    {"BEQ", addressing_mode::relative, 2, false},  // 0xF0
+    {"SBC", addressing_mode::indirect_y, 5, false},  // 0xF1
+    {"JAM", addressing_mode::implied, 2, true},  // 0xF2
+    {"ISC", addressing_mode::indirect_y, 8, true},  // 0xF3
+    {"NOP", addressing_mode::zero_page_x, 4, true},  // 0xF4
+    {"SBC", addressing_mode::zero_page_x, 4, false},  // 0xF5
+    {"INC", addressing_mode::zero_page_x, 6, false},  // 0xF6
+    {"ISC", addressing_mode::zero_page_x, 6, true},  // 0xF7
+    {"SED", addressing_mode::implied, 2, false},  // 0xF8
+    {"SBC", addressing_mode::absolute_y, 4, false},  // 0xF9
+    {"NOP", addressing_mode::implied, 2, true},  // 0xFA
+    {"ISC", addressing_mode::absolute_y, 7, true},  // 0xFB
+    {"NOP", addressing_mode::absolute_x, 4, true},  // 0xFC
+    {"SBC", addressing_mode::absolute_x, 4, false},  // 0xFD
+    {"INC", addressing_mode::absolute_x, 7, false},  // 0xFE
+    {"ISC", addressing_mode::absolute_x, 7, true},  // 0xFF
+}};
+
+#endif  // NES_OPCODE_INFO_H
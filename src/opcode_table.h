@@ -0,0 +1,298 @@
+#ifndef NES_OPCODE_TABLE_H
+#define NES_OPCODE_TABLE_H
+
+#include <array>
+#include <type_traits>
+#include "cpu_registers.h"
+#include "opcodes.h"
+#include "ram_controller.h"
+
+namespace opcode {
+
+// Uniform signature every opcode is dispatched through
+using handler = int (*)(cpu_registers&, ram_controller&) noexcept;
+using handler_table = std::array<handler, 256>;
+
+// Adapts an opcode implementation that only takes the registers (or nothing
+// at all) to the handler signature.
+template <auto Implementation>
+[[nodiscard]] int invoke(cpu_registers& regs, ram_controller& mem) noexcept {
+  if constexpr (std::is_invocable_v<decltype(Implementation), cpu_registers&,
+                                    ram_controller&>) {
+    return Implementation(regs, mem);
+  } else if constexpr (std::is_invocable_v<decltype(Implementation),
+                                           cpu_registers&>) {
+    return Implementation(regs);
+  } else {
+    return Implementation();
+  }
+}
+
+[[nodiscard]] constexpr handler_table make_handler_table() noexcept {
+  handler_table table{};
+  table[0x00] = &invoke<brk_implied>;
+  table[0x01] = &invoke<ora_indirect_x>;
+  table[0x02] = &invoke<jam_implied>;
+  table[0x03] = &invoke<slo_indirect_x>;
+  table[0x04] = &invoke<nop_zero_page>;
+  table[0x05] = &invoke<ora_zero_page>;
+  table[0x06] = &invoke<asl_zero_page>;
+  table[0x07] = &invoke<slo_zero_page>;
+  table[0x08] = &invoke<php_implied>;
+  table[0x09] = &invoke<ora_immediate>;
+  table[0x0A] = &invoke<asl_accumulator>;
+  table[0x0B] = &invoke<anc_immediate>;
+  table[0x0C] = &invoke<nop_absolute>;
+  table[0x0D] = &invoke<ora_absolute>;
+  table[0x0E] = &invoke<asl_absolute>;
+  table[0x0F] = &invoke<slo_absolute>;
+  table[0x10] = &invoke<bpl_relative>;
+  table[0x11] = &invoke<ora_indirect_y>;
+  table[0x12] = &invoke<jam_implied>;
+  table[0x13] = &invoke<slo_indirect_y>;
+  table[0x14] = &invoke<nop_zero_page_x>;
+  table[0x15] = &invoke<ora_zero_page_x>;
+  table[0x16] = &invoke<asl_zero_page_x>;
+  table[0x17] = &invoke<slo_zero_page_x>;
+  table[0x18] = &invoke<clc_implied>;
+  table[0x19] = &invoke<ora_absolute_y>;
+  table[0x1A] = &invoke<nop_implied>;
+  table[0x1B] = &invoke<slo_absolute_y>;
+  table[0x1C] = &invoke<nop_absolute_x>;
+  table[0x1D] = &invoke<ora_absolute_x>;
+  table[0x1E] = &invoke<asl_absolute_x>;
+  table[0x1F] = &invoke<slo_absolute_x>;
+  table[0x20] = &invoke<jsr_absolute>;
+  table[0x21] = &invoke<and_indirect_x>;
+  table[0x22] = &invoke<jam_implied>;
+  table[0x23] = &invoke<rla_indirect_x>;
+  table[0x24] = &invoke<bit_zero_page>;
+  table[0x25] = &invoke<and_zero_page>;
+  table[0x26] = &invoke<rol_zero_page>;
+  table[0x27] = &invoke<rla_zero_page>;
+  table[0x28] = &invoke<plp_implied>;
+  table[0x29] = &invoke<and_immediate>;
+  table[0x2A] = &invoke<rol_accumulator>;
+  table[0x2B] = &invoke<anc_immediate>;
+  table[0x2C] = &invoke<bit_absolute>;
+  table[0x2D] = &invoke<and_absolute>;
+  table[0x2E] = &invoke<rol_absolute>;
+  table[0x2F] = &invoke<rla_absolute>;
+  table[0x30] = &invoke<bmi_relative>;
+  table[0x31] = &invoke<and_indirect_y>;
+  table[0x32] = &invoke<jam_implied>;
+  table[0x33] = &invoke<rla_indirect_y>;
+  table[0x34] = &invoke<nop_zero_page_x>;
+  table[0x35] = &invoke<and_zero_page_x>;
+  table[0x36] = &invoke<rol_zero_page_x>;
+  table[0x37] = &invoke<rla_zero_page_x>;
+  table[0x38] = &invoke<sec_implied>;
+  table[0x39] = &invoke<and_absolute_y>;
+  table[0x3A] = &invoke<nop_implied>;
+  table[0x3B] = &invoke<rla_absolute_y>;
+  table[0x3C] = &invoke<nop_absolute_x>;
+  table[0x3D] = &invoke<and_absolute_x>;
+  table[0x3E] = &invoke<rol_absolute_x>;
+  table[0x3F] = &invoke<rla_absolute_x>;
+  table[0x40] = &invoke<rti_implied>;
+  table[0x41] = &invoke<eor_indirect_x>;
+  table[0x42] = &invoke<jam_implied>;
+  table[0x43] = &invoke<sre_indirect_x>;
+  table[0x44] = &invoke<nop_zero_page>;
+  table[0x45] = &invoke<eor_zero_page>;
+  table[0x46] = &invoke<lsr_zero_page>;
+  table[0x47] = &invoke<sre_zero_page>;
+  table[0x48] = &invoke<pha_implied>;
+  table[0x49] = &invoke<eor_immediate>;
+  table[0x4A] = &invoke<lsr_accumulator>;
+  table[0x4B] = &invoke<alr_immediate>;
+  table[0x4C] = &invoke<jmp_absolute>;
+  table[0x4D] = &invoke<eor_absolute>;
+  table[0x4E] = &invoke<lsr_absolute>;
+  table[0x4F] = &invoke<sre_absolute>;
+  table[0x50] = &invoke<bvc_relative>;
+  table[0x51] = &invoke<eor_indirect_y>;
+  table[0x52] = &invoke<jam_implied>;
+  table[0x53] = &invoke<sre_indirect_y>;
+  table[0x54] = &invoke<nop_zero_page_x>;
+  table[0x55] = &invoke<eor_zero_page_x>;
+  table[0x56] = &invoke<lsr_zero_page_x>;
+  table[0x57] = &invoke<sre_zero_page_x>;
+  table[0x58] = &invoke<cli_implied>;
+  table[0x59] = &invoke<eor_absolute_y>;
+  table[0x5A] = &invoke<nop_implied>;
+  table[0x5B] = &invoke<sre_absolute_y>;
+  table[0x5C] = &invoke<nop_absolute_x>;
+  table[0x5D] = &invoke<eor_absolute_x>;
+  table[0x5E] = &invoke<lsr_absolute_x>;
+  table[0x5F] = &invoke<sre_absolute_x>;
+  table[0x60] = &invoke<rts_implied>;
+  table[0x61] = &invoke<adc_indirect_x>;
+  table[0x62] = &invoke<jam_implied>;
+  table[0x63] = &invoke<rra_indirect_x>;
+  table[0x64] = &invoke<nop_zero_page>;
+  table[0x65] = &invoke<adc_zero_page>;
+  table[0x66] = &invoke<ror_zero_page>;
+  table[0x67] = &invoke<rra_zero_page>;
+  table[0x68] = &invoke<pla_implied>;
+  table[0x69] = &invoke<adc_immediate>;
+  table[0x6A] = &invoke<ror_accumulator>;
+  table[0x6B] = &invoke<arr_immediate>;
+  table[0x6C] = &invoke<jmp_indirect>;
+  table[0x6D] = &invoke<adc_absolute>;
+  table[0x6E] = &invoke<ror_absolute>;
+  table[0x6F] = &invoke<rra_absolute>;
+  table[0x70] = &invoke<bvs_relative>;
+  table[0x71] = &invoke<adc_indirect_y>;
+  table[0x72] = &invoke<jam_implied>;
+  table[0x73] = &invoke<rra_indirect_y>;
+  table[0x74] = &invoke<nop_zero_page_x>;
+  table[0x75] = &invoke<adc_zero_page_x>;
+  table[0x76] = &invoke<ror_zero_page_x>;
+  table[0x77] = &invoke<rra_zero_page_x>;
+  table[0x78] = &invoke<sei_implied>;
+  table[0x79] = &invoke<adc_absolute_y>;
+  table[0x7A] = &invoke<nop_implied>;
+  table[0x7B] = &invoke<rra_absolute_y>;
+  table[0x7C] = &invoke<nop_absolute_x>;
+  table[0x7D] = &invoke<adc_absolute_x>;
+  table[0x7E] = &invoke<ror_absolute_x>;
+  table[0x7F] = &invoke<rra_absolute_x>;
+  table[0x80] = &invoke<nop_immediate>;
+  table[0x81] = &invoke<sta_indirect_x>;
+  table[0x82] = &invoke<nop_immediate>;
+  table[0x83] = &invoke<sax_indirect_x>;
+  table[0x84] = &invoke<sty_zero_page>;
+  table[0x85] = &invoke<sta_zero_page>;
+  table[0x86] = &invoke<stx_zero_page>;
+  table[0x87] = &invoke<sax_zero_page>;
+  table[0x88] = &invoke<dey_implied>;
+  table[0x89] = &invoke<nop_immediate>;
+  table[0x8A] = &invoke<txa_implied>;
+  table[0x8B] = &invoke<xaa_immediate>;
+  table[0x8C] = &invoke<sty_absolute>;
+  table[0x8D] = &invoke<sta_absolute>;
+  table[0x8E] = &invoke<stx_absolute>;
+  table[0x8F] = &invoke<sax_absolute>;
+  table[0x90] = &invoke<bcc_relative>;
+  table[0x91] = &invoke<sta_indirect_y>;
+  table[0x92] = &invoke<jam_implied>;
+  table[0x93] = &invoke<ahx_indirect_y>;
+  table[0x94] = &invoke<sty_zero_page_x>;
+  table[0x95] = &invoke<sta_zero_page_x>;
+  table[0x96] = &invoke<stx_zero_page_y>;
+  table[0x97] = &invoke<sax_zero_page_y>;
+  table[0x98] = &invoke<tya_implied>;
+  table[0x99] = &invoke<sta_absolute_y>;
+  table[0x9A] = &invoke<txs_implied>;
+  table[0x9B] = &invoke<tas_absolute_y>;
+  table[0x9C] = &invoke<shy_absolute_x>;
+  table[0x9D] = &invoke<sta_absolute_x>;
+  table[0x9E] = &invoke<shx_absolute_y>;
+  table[0x9F] = &invoke<ahx_absolute_y>;
+  table[0xA0] = &invoke<ldy_immediate>;
+  table[0xA1] = &invoke<lda_indirect_x>;
+  table[0xA2] = &invoke<ldx_immediate>;
+  table[0xA3] = &invoke<lax_indirect_x>;
+  table[0xA4] = &invoke<ldy_zero_page>;
+  table[0xA5] = &invoke<lda_zero_page>;
+  table[0xA6] = &invoke<ldx_zero_page>;
+  table[0xA7] = &invoke<lax_zero_page>;
+  table[0xA8] = &invoke<tay_implied>;
+  table[0xA9] = &invoke<lda_immediate>;
+  table[0xAA] = &invoke<tax_implied>;
+  table[0xAB] = &invoke<lax_immediate>;
+  table[0xAC] = &invoke<ldy_absolute>;
+  table[0xAD] = &invoke<lda_absolute>;
+  table[0xAE] = &invoke<ldx_absolute>;
+  table[0xAF] = &invoke<lax_absolute>;
+  table[0xB0] = &invoke<bcs_relative>;
+  table[0xB1] = &invoke<lda_indirect_y>;
+  table[0xB2] = &invoke<jam_implied>;
+  table[0xB3] = &invoke<lax_indirect_y>;
+  table[0xB4] = &invoke<ldy_zero_page_x>;
+  table[0xB5] = &invoke<lda_zero_page_x>;
+  table[0xB6] = &invoke<ldx_zero_page_y>;
+  table[0xB7] = &invoke<lax_zero_page_y>;
+  table[0xB8] = &invoke<clv_implied>;
+  table[0xB9] = &invoke<lda_absolute_y>;
+  table[0xBA] = &invoke<tsx_implied>;
+  table[0xBB] = &invoke<las_absolute_y>;
+  table[0xBC] = &invoke<ldy_absolute_x>;
+  table[0xBD] = &invoke<lda_absolute_x>;
+  table[0xBE] = &invoke<ldx_absolute_y>;
+  table[0xBF] = &invoke<lax_absolute_y>;
+  table[0xC0] = &invoke<cpy_immediate>;
+  table[0xC1] = &invoke<cmp_indirect_x>;
+  table[0xC2] = &invoke<nop_immediate>;
+  table[0xC3] = &invoke<dcp_indirect_x>;
+  table[0xC4] = &invoke<cpy_zero_page>;
+  table[0xC5] = &invoke<cmp_zero_page>;
+  table[0xC6] = &invoke<dec_zero_page>;
+  table[0xC7] = &invoke<dcp_zero_page>;
+  table[0xC8] = &invoke<iny_implied>;
+  table[0xC9] = &invoke<cmp_immediate>;
+  table[0xCA] = &invoke<dex_implied>;
+  table[0xCB] = &invoke<axs_immediate>;
+  table[0xCC] = &invoke<cpy_absolute>;
+  table[0xCD] = &invoke<cmp_absolute>;
+  table[0xCE] = &invoke<dec_absolute>;
+  table[0xCF] = &invoke<dcp_absolute>;
+  table[0xD0] = &invoke<bne_relative>;
+  table[0xD1] = &invoke<cmp_indirect_y>;
+  table[0xD2] = &invoke<jam_implied>;
+  table[0xD3] = &invoke<dcp_indirect_y>;
+  table[0xD4] = &invoke<nop_zero_page_x>;
+  table[0xD5] = &invoke<cmp_zero_page_x>;
+  table[0xD6] = &invoke<dec_zero_page_x>;
+  table[0xD7] = &invoke<dcp_zero_page_x>;
+  table[0xD8] = &invoke<cld_implied>;
+  table[0xD9] = &invoke<cmp_absolute_y>;
+  table[0xDA] = &invoke<nop_implied>;
+  table[0xDB] = &invoke<dcp_absolute_y>;
+  table[0xDC] = &invoke<nop_absolute_x>;
+  table[0xDD] = &invoke<cmp_absolute_x>;
+  table[0xDE] = &invoke<dec_absolute_x>;
+  table[0xDF] = &invoke<dcp_absolute_x>;
+  table[0xE0] = &invoke<cpx_immediate>;
+  table[0xE1] = &invoke<sbc_indirect_x>;
+  table[0xE2] = &invoke<nop_immediate>;
+  table[0xE3] = &invoke<isc_indirect_x>;
+  table[0xE4] = &invoke<cpx_zero_page>;
+  table[0xE5] = &invoke<sbc_zero_page>;
+  table[0xE6] = &invoke<inc_zero_page>;
+  table[0xE7] = &invoke<isc_zero_page>;
+  table[0xE8] = &invoke<inx_implied>;
+  table[0xE9] = &invoke<sbc_immediate>;
+  table[0xEA] = &invoke<nop_implied>;
+  table[0xEB] = &invoke<sbc_immediate>;
+  table[0xEC] = &invoke<cpx_absolute>;
+  table[0xED] = &invoke<sbc_absolute>;
+  table[0xEE] = &invoke<inc_absolute>;
+  table[0xEF] = &invoke<isc_absolute>;
+  table[0xF0] = &invoke<beq_relative>;
+  table[0xF1] = &invoke<sbc_indirect_y>;
+  table[0xF2] = &invoke<jam_implied>;
+  table[0xF3] = &invoke<isc_indirect_y>;
+  table[0xF4] = &invoke<nop_zero_page_x>;
+  table[0xF5] = &invoke<sbc_zero_page_x>;
+  table[0xF6] = &invoke<inc_zero_page_x>;
+  table[0xF7] = &invoke<isc_zero_page_x>;
+  table[0xF8] = &invoke<sed_implied>;
+  table[0xF9] = &invoke<sbc_absolute_y>;
+  table[0xFA] = &invoke<nop_implied>;
+  table[0xFB] = &invoke<isc_absolute_y>;
+  table[0xFC] = &invoke<nop_absolute_x>;
+  table[0xFD] = &invoke<sbc_absolute_x>;
+  table[0xFE] = &invoke<inc_absolute_x>;
+  table[0xFF] = &invoke<isc_absolute_x>;
+  return table;
+}
+
+// The default handler set, indexed by opcode. inline, so that cpu2a03 gets
+// the same template argument in every translation unit.
+inline constexpr handler_table handlers = make_handler_table();
+
+}  // namespace opcode
+
+#endif  // NES_OPCODE_TABLE_H
@@ -2,9 +2,7 @@
 #define NES_OPCODES_H
 
 #include <cstddef>
-#include <iostream>
 #include "cpu_registers.h"
-#include "fmt/format.h"
 #include "ram_controller.h"
 
 template <unsigned int BitNum>
@@ -30,10 +28,10 @@ struct addressing_result {
   bool page_boundary_crossed;
 };
 
-[[nodiscard]] /*constexpr*/ auto immediate(cpu_registers& regs,
-                                           const ram_controller& mem) noexcept {
+[[nodiscard]] /*constexpr*/ auto immediate(
+    cpu_registers& regs,
+    const ram_controller& /*mem*/) noexcept {
   auto address = regs.increment_pc();
-  std::cout << fmt::format("{:02X}      ", mem.read8(address));
   return address;
 }
 
@@ -47,7 +45,6 @@ struct addressing_result {
                                           const ram_controller& mem) noexcept {
   auto low = mem.read8(regs.increment_pc());
   auto high = mem.read8(regs.increment_pc());
-  std::cout << fmt::format("{:02X} {:02X}   ", low, high);
   return static_cast<std::uint16_t>(low |
                                     static_cast<std::uint16_t>(high << 8U));
 }
@@ -65,8 +62,6 @@ struct addressing_result {
   auto low = mem.read8(regs.increment_pc());
   auto high = mem.read8(regs.increment_pc());
 
-  std::cout << fmt::format("{:02X} {:02X}   ", low, high);
-
   low = low + index;
   if (low < index) {
     result.page_boundary_crossed = true;
@@ -81,7 +76,6 @@ struct addressing_result {
 [[nodiscard]] /*constexpr*/ auto zero_page(cpu_registers& regs,
                                            const ram_controller& mem) noexcept {
   auto low = mem.read8(regs.increment_pc());
-  std::cout << fmt::format("{:02X}      ", low);
   return static_cast<std::uint16_t>(low);
 }
 
@@ -95,7 +89,6 @@ struct addressing_result {
     cpu_registers& regs,
     const ram_controller& mem) noexcept {
   auto zero_page_addr = mem.read8(regs.increment_pc());
-  std::cout << fmt::format("{:02X}      ", zero_page_addr);
   return static_cast<std::uint16_t>(
       static_cast<std::uint8_t>(zero_page_addr + regs.x()));
 }
@@ -110,7 +103,6 @@ struct addressing_result {
     cpu_registers& regs,
     const ram_controller& mem) noexcept {
   auto zero_page_addr = mem.read8(regs.increment_pc());
-  std::cout << fmt::format("{:02X}      ", zero_page_addr);
   return static_cast<std::uint16_t>(
       static_cast<std::uint8_t>(zero_page_addr + regs.y()));
 }
@@ -124,7 +116,6 @@ struct addressing_result {
 [[nodiscard]] /*constexpr*/ auto relative(cpu_registers& regs,
                                           const ram_controller& mem) noexcept {
   auto low = mem.read8(regs.increment_pc());
-  std::cout << fmt::format("{:02X}      ", low);
   return static_cast<std::int8_t>(low);
 }
 
@@ -133,8 +124,6 @@ struct addressing_result {
   auto low = mem.read8(regs.increment_pc());
   auto high = mem.read8(regs.increment_pc());
 
-  std::cout << fmt::format("{:02X} {:02X}   ", low, high);
-
   auto address =
       static_cast<std::uint16_t>(low | static_cast<std::uint16_t>(high << 8U));
 
@@ -160,8 +149,6 @@ struct addressing_result {
   auto low = mem.read8(regs.increment_pc());
   auto zero_page_addr = static_cast<std::uint8_t>(low + regs.x());
 
-  std::cout << fmt::format("{:02X}      ", low);
-
   return static_cast<std::uint16_t>(
       mem.read8(zero_page_addr) |
       static_cast<std::uint16_t>(
@@ -174,8 +161,6 @@ struct addressing_result {
   addressing_result result{};
   auto zero_page_addr = mem.read8(regs.increment_pc());
 
-  std::cout << fmt::format("{:02X}      ", zero_page_addr);
-
   auto low = mem.read8(zero_page_addr);
   auto high = mem.read8(static_cast<std::uint8_t>(zero_page_addr + 1U));
 
@@ -222,7 +207,6 @@ namespace opcode {
 
 [[nodiscard]] /*constexpr*/ int php_implied(cpu_registers& regs,
                                             ram_controller& mem) noexcept {
-  std::cout << "        ";
   // From the nesdev wiki:
   // In the byte pushed, bit 5 is always set to 1, and bit 4 is 1 if from an
   // instruction (PHP or BRK) or 0 if from an interrupt line being pulled low
@@ -236,7 +220,6 @@ namespace opcode {
 [[nodiscard]] /*constexpr*/ int plp_implied(
     cpu_registers& regs,
     const ram_controller& mem) noexcept {
-  std::cout << "        ";
   // PLP ignores bit 4 and 5. 5 is unused and should always be 1.
   auto status = pop_stack(regs, mem);
   status = status | static_cast<std::uint8_t>(cpu_flag::unused);
@@ -323,7 +306,6 @@ namespace opcode {
 }
 
 [[nodiscard]] /*constexpr*/ int asl_accumulator(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_flag_if(cpu_flag::carry, (regs.accumulator() & 0x80U) == 0x80U);
   regs.set_accumulator(static_cast<std::uint8_t>(regs.accumulator() << 1U));
   // asl(regs, regs.accumulator());
@@ -364,7 +346,6 @@ namespace opcode {
 [[nodiscard]] /*constexpr*/ int pla_implied(
     cpu_registers& regs,
     const ram_controller& mem) noexcept {
-  std::cout << "        ";
   regs.set_accumulator(pop_stack(regs, mem));
 
   return 4;
@@ -373,7 +354,6 @@ namespace opcode {
 [[nodiscard]] /*constexpr*/ int rts_implied(
     cpu_registers& regs,
     const ram_controller& mem) noexcept {
-  std::cout << "        ";
   auto low = pop_stack(regs, mem);
   auto high = pop_stack(regs, mem) << 8U;
   auto address =
@@ -384,21 +364,18 @@ namespace opcode {
 }
 
 /*constexpr*/ void adc(cpu_registers& regs, std::uint8_t value) {
-  auto result = regs.accumulator() + value +
-                (regs.status() & static_cast<unsigned>(cpu_flag::carry));
+  auto result = regs.accumulator() + value + regs.carry();
 
   // If we wrapped around, set carry flag
-  regs.set_flag_if(cpu_flag::carry, result > 0xFF);
+  regs.set_carry_bit8(result);
 
   // Set overflow if sign bit is incorrect
   // That is, if the numbers added have identical signs, but the sign of the
   // result differs, set overflow.
-  regs.set_flag_if(cpu_flag::overflow,
-                   static_cast<std::uint8_t>(
-                       static_cast<std::uint8_t>(~static_cast<std::uint8_t>(
-                           regs.accumulator() ^ value)) &
-                       static_cast<std::uint8_t>(regs.accumulator() ^ result)) &
-                       0x80U);
+  regs.set_overflow_bit7(static_cast<std::uint8_t>(
+      static_cast<std::uint8_t>(
+          ~static_cast<std::uint8_t>(regs.accumulator() ^ value)) &
+      static_cast<std::uint8_t>(regs.accumulator() ^ result)));
   regs.set_accumulator(result & 0xFFU);
 }
 
@@ -472,7 +449,6 @@ namespace opcode {
 }
 
 [[nodiscard]] /*constexpr*/ int sei_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_flag(cpu_flag::interrupt_disable);
   return 2;
 }
@@ -504,7 +480,6 @@ namespace opcode {
 }
 
 [[nodiscard]] /*constexpr*/ int cld_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.clear_flag(cpu_flag::clear_decimal_mode);
   return 2;
 }
@@ -663,31 +638,26 @@ namespace opcode {
 }
 
 [[nodiscard]] /*constexpr*/ int tay_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_y(regs.accumulator());
   return 2;
 }
 
 [[nodiscard]] /*constexpr*/ int tax_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_x(regs.accumulator());
   return 2;
 }
 
 [[nodiscard]] /*constexpr*/ int tsx_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_x(regs.stack() & 0xFFU);
   return 2;
 }
 
 [[nodiscard]] /*constexpr*/ int txa_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_accumulator(regs.x());
   return 2;
 }
 
 [[nodiscard]] /*constexpr*/ int tya_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_accumulator(regs.y());
   return 2;
 }
@@ -706,7 +676,6 @@ namespace opcode {
 }
 
 [[nodiscard]] /*constexpr*/ int txs_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_stack(regs.x());
   return 2;
 }
@@ -770,7 +739,7 @@ namespace opcode {
 [[nodiscard]] /*constexpr*/ int sax_zero_page(cpu_registers& regs,
                                               ram_controller& mem) noexcept {
   mem.write8(mode::zero_page(regs, mem), regs.accumulator() & regs.x());
-  return 6;
+  return 3;
 }
 
 [[nodiscard]] /*constexpr*/ int sax_zero_page_y(cpu_registers& regs,
@@ -859,7 +828,6 @@ namespace opcode {
 }
 
 [[nodiscard]] /*constexpr*/ int clc_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.clear_flag(cpu_flag::carry);
   return 2;
 }
@@ -909,8 +877,6 @@ namespace opcode {
 }
 
 [[nodiscard]] /*constexpr*/ int rol_accumulator(cpu_registers& regs) noexcept {
-  std::cout << "        ";
-
   auto result = static_cast<std::uint8_t>(regs.accumulator() << 1U);
   if (regs.flag(cpu_flag::carry)) {
     result |= 0x01;
@@ -966,7 +932,6 @@ namespace opcode {
 }
 
 [[nodiscard]] /*constexpr*/ int ror_accumulator(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   auto result = static_cast<std::uint8_t>(regs.accumulator() >> 1U);
 
   if (regs.flag(cpu_flag::carry)) {
@@ -1118,21 +1083,18 @@ namespace opcode {
 }
 
 [[nodiscard]] /*constexpr*/ int sec_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_flag(cpu_flag::carry);
   return 2;
 }
 
 [[nodiscard]] /*constexpr*/ int pha_implied(cpu_registers& regs,
                                             ram_controller& mem) noexcept {
-  std::cout << "        ";
   push_stack(regs, mem, regs.accumulator());
 
   return 3;
 }
 
 [[nodiscard]] /*constexpr*/ int lsr_accumulator(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   auto old_value = regs.accumulator();
   regs.set_flag_if(cpu_flag::carry, (old_value & 1U) == 1U);
   regs.set_accumulator(old_value >> 1U);
@@ -1229,7 +1191,6 @@ namespace opcode {
 }
 
 [[nodiscard]] /*constexpr*/ int clv_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.clear_flag(cpu_flag::overflow);
   return 2;
 }
@@ -1237,11 +1198,10 @@ namespace opcode {
 /*constexpr*/ void cmp(cpu_registers& regs,
                        std::uint8_t register_value,
                        std::uint8_t value) noexcept {
-  regs.set_flag_if(cpu_flag::carry, register_value >= value);
-  regs.set_flag_if(cpu_flag::zero, register_value == value);
-
-  auto result = static_cast<std::uint8_t>(register_value - value);
-  regs.set_flag_if(cpu_flag::sign, (result & bitmask<7>()) == bitmask<7>());
+  // Bit 8 is set unless the subtraction borrows, which is when carry is set
+  auto difference = register_value + 0x100U - value;
+  regs.set_carry_bit8(difference);
+  regs.set_nz(static_cast<std::uint8_t>(difference));
 }
 
 [[nodiscard]] /*constexpr*/ int cmp_immediate(
@@ -1391,13 +1351,11 @@ namespace opcode {
 }
 
 [[nodiscard]] /*constexpr*/ int dex_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_x(regs.x() - 1U);
   return 2;
 }
 
 [[nodiscard]] /*constexpr*/ int dey_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_y(regs.y() - 1U);
   return 2;
 }
@@ -1468,14 +1426,13 @@ namespace opcode {
 [[nodiscard]] /*constexpr*/ int rti_implied(
     cpu_registers& regs,
     const ram_controller& mem) noexcept {
-  std::cout << "        ";
   regs.set_status(pop_stack(regs, mem) |
                   static_cast<std::uint8_t>(cpu_flag::unused));
   regs.set_pc(static_cast<std::uint16_t>(
       pop_stack(regs, mem) |
       static_cast<std::uint16_t>(pop_stack(regs, mem) << 8U)));
 
-  return 3;
+  return 6;
 }
 
 /*constexpr*/ void inc(cpu_registers& regs,
@@ -1514,13 +1471,11 @@ namespace opcode {
 }
 
 [[nodiscard]] /*constexpr*/ int inx_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_x(regs.x() + 1U);
   return 2;
 }
 
 [[nodiscard]] /*constexpr*/ int iny_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_y(regs.y() + 1U);
   return 2;
 }
@@ -1597,39 +1552,37 @@ namespace opcode {
 }
 
 [[nodiscard]] /*constexpr*/ int sed_implied(cpu_registers& regs) noexcept {
-  std::cout << "        ";
   regs.set_flag(cpu_flag::clear_decimal_mode);
   return 2;
 }
 
 [[nodiscard]] /*constexpr*/ int nop_implied() noexcept {
-  std::cout << "        ";
   return 2;
 }
 
 [[nodiscard]] /*constexpr*/ int nop_immediate(cpu_registers& regs,
                                               ram_controller& mem) noexcept {
-  // TODO: This is just here for the output log, can remove later as
-  // immediate reads have no side effects
-  mode::immediate_read(regs, mem);
+  // The operand is still fetched to advance the PC, immediate reads have no
+  // side effects
+  static_cast<void>(mode::immediate_read(regs, mem));
   return 2;
 }
 
 [[nodiscard]] /*constexpr*/ int nop_zero_page(
     cpu_registers& regs,
     const ram_controller& mem) noexcept {
-  // TODO: This is just here for the output log, can remove later as
-  // zero page reads have no side effects
-  mode::zero_page(regs, mem);
+  // The operand is still fetched to advance the PC, zero page reads have no
+  // side effects
+  static_cast<void>(mode::zero_page(regs, mem));
   return 3;
 }
 
 [[nodiscard]] /*constexpr*/ int nop_zero_page_x(
     cpu_registers& regs,
     const ram_controller& mem) noexcept {
-  // TODO: This is just here for the output log, can remove later as
-  // zero page reads have no side effects
-  mode::zero_page_x(regs, mem);
+  // The operand is still fetched to advance the PC, zero page reads have no
+  // side effects
+  static_cast<void>(mode::zero_page_x(regs, mem));
   return 4;
 }
 
@@ -1962,6 +1915,149 @@ namespace opcode {
   return 7;
 }
 
+// The opcodes below are unofficial. The "unstable" ones (XAA, LAX immediate,
+// AHX, TAS, SHX, SHY) behave differently between individual chips, we use the
+// behaviour most commonly documented on the nesdev wiki.
+
+[[nodiscard]] /*constexpr*/ int jam_implied(cpu_registers& regs) noexcept {
+  // Locks up the CPU until reset. We emulate that by never moving the PC past
+  // the opcode, so time keeps passing for the rest of the system.
+  regs.set_pc(static_cast<std::uint16_t>(regs.pc() - 1U));
+  return 2;
+}
+
+[[nodiscard]] /*constexpr*/ int anc_immediate(
+    cpu_registers& regs,
+    const ram_controller& mem) noexcept {
+  regs.set_accumulator(regs.accumulator() & mode::immediate_read(regs, mem));
+  regs.set_flag_if(cpu_flag::carry, regs.flag(cpu_flag::sign));
+  return 2;
+}
+
+[[nodiscard]] /*constexpr*/ int alr_immediate(
+    cpu_registers& regs,
+    const ram_controller& mem) noexcept {
+  auto value = static_cast<std::uint8_t>(regs.accumulator() &
+                                         mode::immediate_read(regs, mem));
+  regs.set_flag_if(cpu_flag::carry, (value & 1U) == 1U);
+  regs.set_accumulator(static_cast<std::uint8_t>(value >> 1U));
+  return 2;
+}
+
+[[nodiscard]] /*constexpr*/ int arr_immediate(
+    cpu_registers& regs,
+    const ram_controller& mem) noexcept {
+  auto value = static_cast<std::uint8_t>(regs.accumulator() &
+                                         mode::immediate_read(regs, mem));
+  auto result = static_cast<std::uint8_t>(value >> 1U);
+  if (regs.flag(cpu_flag::carry)) {
+    result |= 0x80U;
+  }
+  regs.set_accumulator(result);
+  // Carry and overflow come from bit 6 and bit 6 xor bit 5 of the result
+  regs.set_flag_if(cpu_flag::carry, (result & bitmask<6>()) != 0);
+  regs.set_flag_if(cpu_flag::overflow,
+                   (((result >> 6U) ^ (result >> 5U)) & 1U) == 1U);
+  return 2;
+}
+
+[[nodiscard]] /*constexpr*/ int axs_immediate(
+    cpu_registers& regs,
+    const ram_controller& mem) noexcept {
+  auto value = mode::immediate_read(regs, mem);
+  auto register_value =
+      static_cast<std::uint8_t>(regs.accumulator() & regs.x());
+  cmp(regs, register_value, value);
+  regs.set_x(static_cast<std::uint8_t>(register_value - value));
+  return 2;
+}
+
+[[nodiscard]] /*constexpr*/ int lax_immediate(
+    cpu_registers& regs,
+    const ram_controller& mem) noexcept {
+  // Unstable, A is ORed with a chip dependent constant first. We assume $FF.
+  regs.set_accumulator(mode::immediate_read(regs, mem));
+  regs.set_x(regs.accumulator());
+  return 2;
+}
+
+[[nodiscard]] /*constexpr*/ int xaa_immediate(
+    cpu_registers& regs,
+    const ram_controller& mem) noexcept {
+  // Unstable, A is ORed with a chip dependent constant first. We assume $FF.
+  regs.set_accumulator(regs.x() & mode::immediate_read(regs, mem));
+  return 2;
+}
+
+[[nodiscard]] /*constexpr*/ int las_absolute_y(
+    cpu_registers& regs,
+    const ram_controller& mem) noexcept {
+  auto result = mode::absolute_indexed(regs, mem, regs.y());
+  auto value = static_cast<std::uint8_t>(mem.read8(result.address) &
+                                         regs.stack());
+  regs.set_accumulator(value);
+  regs.set_x(value);
+  regs.set_stack(value);
+  return result.page_boundary_crossed ? 5 : 4;
+}
+
+// Shared by AHX, TAS, SHX and SHY. The stored value is ANDed with the high
+// byte of the unindexed address + 1, and when indexing crosses a page that
+// value also replaces the high byte of the address written to.
+/*constexpr*/ void store_and_high(ram_controller& mem,
+                                  mode::addressing_result result,
+                                  std::uint8_t index,
+                                  std::uint8_t value) noexcept {
+  auto base_high = static_cast<std::uint8_t>(
+      static_cast<std::uint16_t>(result.address - index) >> 8U);
+  auto stored = static_cast<std::uint8_t>(value & (base_high + 1U));
+  auto address = result.address;
+  if (result.page_boundary_crossed) {
+    address = static_cast<std::uint16_t>((address & 0xFFU) |
+                                         static_cast<unsigned>(stored << 8U));
+  }
+  mem.write8(address, stored);
+}
+
+[[nodiscard]] /*constexpr*/ int ahx_indirect_y(cpu_registers& regs,
+                                               ram_controller& mem) noexcept {
+  auto addressing = mode::indirect_indexed(regs, mem);
+  store_and_high(mem, addressing, regs.y(),
+                 static_cast<std::uint8_t>(regs.accumulator() & regs.x()));
+  return 6;
+}
+
+[[nodiscard]] /*constexpr*/ int ahx_absolute_y(cpu_registers& regs,
+                                               ram_controller& mem) noexcept {
+  auto result = mode::absolute_indexed(regs, mem, regs.y());
+  store_and_high(mem, result, regs.y(),
+                 static_cast<std::uint8_t>(regs.accumulator() & regs.x()));
+  return 5;
+}
+
+[[nodiscard]] /*constexpr*/ int tas_absolute_y(cpu_registers& regs,
+                                               ram_controller& mem) noexcept {
+  auto result = mode::absolute_indexed(regs, mem, regs.y());
+  regs.set_stack(static_cast<std::uint8_t>(regs.accumulator() & regs.x()));
+  store_and_high(mem, result, regs.y(),
+                 static_cast<std::uint8_t>(regs.stack() & 0xFFU));
+  return 5;
+}
+
+[[nodiscard]] /*constexpr*/ int shy_absolute_x(cpu_registers& regs,
+                                               ram_controller& mem) noexcept {
+  auto result = mode::absolute_indexed(regs, mem, regs.x());
+  store_and_high(mem, result, regs.x(), regs.y());
+  return 5;
+}
+
+[[nodiscard]] /*constexpr*/ int shx_absolute_y(cpu_registers& regs,
+                                               ram_controller& mem) noexcept {
+  auto result = mode::absolute_indexed(regs, mem, regs.y());
+  store_and_high(mem, result, regs.y(), regs.x());
+  return 5;
+}
+
 }  // namespace opcode
 
 #endif  // NES_OPCODES_H
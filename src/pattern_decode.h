@@ -0,0 +1,156 @@
+#ifndef NES_PATTERN_DECODE_H
+#define NES_PATTERN_DECODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+// A row of a tile is stored as two bitplanes, one byte each, with the
+// leftmost pixel in bit 7. Decoding it gives 8 bytes of
+//   (palette << 2) | (high bit << 1) | low bit
+// which is the index into the background or sprite half of palette RAM.
+// Pixels with both bits clear are transparent.
+
+[[nodiscard]] constexpr std::uint8_t reverse_bits(std::uint8_t value) noexcept {
+  std::uint8_t result = 0;
+  for (auto i = 0; i < 8; ++i) {
+    result = static_cast<std::uint8_t>((result << 1U) | (value & 1U));
+    value = static_cast<std::uint8_t>(value >> 1U);
+  }
+  return result;
+}
+
+constexpr void decode_tile_row(std::uint8_t low,
+                               std::uint8_t high,
+                               std::uint8_t palette,
+                               std::uint8_t* out) noexcept {
+  auto base = static_cast<unsigned>(palette) << 2U;
+  for (auto i = 0U; i < 8; ++i) {
+    auto bit = 7U - i;
+    out[i] = static_cast<std::uint8_t>(base | ((low >> bit) & 1U) |
+                                       (((high >> bit) & 1U) << 1U));
+  }
+}
+
+namespace detail {
+
+// Byte i of a vector is tested against the bit of pixel i % 8
+alignas(32) constexpr std::uint8_t pixel_bits[32] = {
+    0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+    0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+    0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+    0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
+
+// pshufb indices spreading tile n of a broadcast to bytes 8n..8n+7. The
+// shuffle works within 128 bit lanes, so the upper lane picks tiles 2 and 3
+// from its own copy of the broadcast.
+alignas(32) constexpr std::uint8_t spread_tiles[32] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3};
+
+#if defined(__AVX2__)
+// Decodes 4 tiles into 32 pixels
+__m256i decode_4_tile_rows(const std::uint8_t* low,
+                           const std::uint8_t* high,
+                           const std::uint8_t* palette) noexcept {
+  const auto bits =
+      _mm256_load_si256(reinterpret_cast<const __m256i*>(pixel_bits));
+  const auto spread =
+      _mm256_load_si256(reinterpret_cast<const __m256i*>(spread_tiles));
+  const auto one = _mm256_set1_epi8(1);
+
+  auto broadcast = [&](const std::uint8_t* bytes) {
+    std::int32_t four;
+    std::memcpy(&four, bytes, sizeof(four));
+    return _mm256_shuffle_epi8(_mm256_set1_epi32(four), spread);
+  };
+
+  auto low_bits =
+      _mm256_min_epu8(_mm256_and_si256(broadcast(low), bits), one);
+  auto high_bits =
+      _mm256_min_epu8(_mm256_and_si256(broadcast(high), bits), one);
+  // Palettes are 0-3, so shifting 16 bit lanes never carries between bytes
+  auto palettes = _mm256_slli_epi16(broadcast(palette), 2);
+
+  return _mm256_or_si256(
+      _mm256_or_si256(low_bits, _mm256_add_epi8(high_bits, high_bits)),
+      palettes);
+}
+#endif
+
+#if defined(__SSSE3__)
+// Decodes 2 tiles into 16 pixels
+__m128i decode_2_tile_rows(const std::uint8_t* low,
+                           const std::uint8_t* high,
+                           const std::uint8_t* palette) noexcept {
+  const auto bits =
+      _mm_load_si128(reinterpret_cast<const __m128i*>(pixel_bits));
+  const auto spread =
+      _mm_load_si128(reinterpret_cast<const __m128i*>(spread_tiles));
+  const auto one = _mm_set1_epi8(1);
+
+  auto broadcast = [&](const std::uint8_t* bytes) {
+    std::int16_t two;
+    std::memcpy(&two, bytes, sizeof(two));
+    return _mm_shuffle_epi8(_mm_set1_epi16(two), spread);
+  };
+
+  auto low_bits = _mm_min_epu8(_mm_and_si128(broadcast(low), bits), one);
+  auto high_bits = _mm_min_epu8(_mm_and_si128(broadcast(high), bits), one);
+  auto palettes = _mm_slli_epi16(broadcast(palette), 2);
+
+  return _mm_or_si128(
+      _mm_or_si128(low_bits, _mm_add_epi8(high_bits, high_bits)), palettes);
+}
+#endif
+
+}  // namespace detail
+
+// Decodes count tile rows into count * 8 pixels. low, high and palette hold
+// one byte per tile.
+void decode_tile_rows(const std::uint8_t* low,
+                      const std::uint8_t* high,
+                      const std::uint8_t* palette,
+                      std::uint8_t* out,
+                      std::size_t count) noexcept {
+  std::size_t tile = 0;
+#if defined(__AVX2__)
+  for (; tile + 4 <= count; tile += 4) {
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(out + tile * 8),
+        detail::decode_4_tile_rows(low + tile, high + tile, palette + tile));
+  }
+#endif
+#if defined(__SSSE3__)
+  for (; tile + 2 <= count; tile += 2) {
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(out + tile * 8),
+        detail::decode_2_tile_rows(low + tile, high + tile, palette + tile));
+  }
+#endif
+  for (; tile < count; ++tile) {
+    decode_tile_row(low[tile], high[tile], palette[tile], out + tile * 8);
+  }
+}
+
+// Size of a decoded tile, one byte per pixel
+constexpr std::size_t decoded_tile_size = 64;
+
+// Decodes count whole tiles (16 bytes of CHR data each) into count * 64
+// pixels without a palette, row after row
+void decode_tiles(const std::uint8_t* chr,
+                  std::size_t count,
+                  std::uint8_t* out) noexcept {
+  constexpr std::uint8_t no_palette[8]{};
+  for (std::size_t tile = 0; tile < count; ++tile) {
+    // The low planes of the 8 rows come first, then the high ones
+    decode_tile_rows(chr + tile * 16, chr + tile * 16 + 8, no_palette,
+                     out + tile * decoded_tile_size, 8);
+  }
+}
+
+#endif  // NES_PATTERN_DECODE_H
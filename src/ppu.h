@@ -1,29 +1,572 @@
 #ifndef NES_PPU_H
 #define NES_PPU_H
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <cstring>
+#include "common.h"
+#include "pattern_decode.h"
+#include "vram_controller.h"
+
+// Everything needed to resume a ppu where it left off, see save_state.h.
+// The framebuffer is output only and not part of it.
+struct ppu_state {
+  std::int32_t scanline;
+  std::int32_t scanline_cycle;
+  std::uint64_t frame;
+  std::uint8_t control;
+  std::uint8_t mask;
+  std::uint8_t status;
+  std::uint8_t data_bus;
+  std::uint8_t read_buffer;
+  std::uint8_t oam_address;
+  std::uint16_t v;
+  std::uint16_t t;
+  std::uint8_t fine_x;
+  bool w;
+  bool nmi_pending;
+  bool odd_frame;
+  std::uint8_t oam[0x100];
+  vram_state vram;
+};
+
+// Cartridge hardware that counts scanlines by watching the PPU address bus,
+// like the MMC3 IRQ counter
+class scanline_counter {
+ public:
+  virtual ~scanline_counter() = default;
+
+  // Called once per rendered scanline, where PPU A12 rises for the sprite
+  // pattern fetches (dot 260 of the pre-render and visible scanlines)
+  virtual void clock_scanline() noexcept = 0;
+};
 
 class ppu {
  public:
-  ppu() : m_odd_frame(false), m_current_scanline(-1), m_scanline_cycle(0) {}
+  static constexpr int dots_per_scanline = 341;
+  static constexpr int scanlines_per_frame = 262;
+  static constexpr int dots_per_frame = dots_per_scanline * scanlines_per_frame;
+  static constexpr int vblank_scanline = 241;
+  static constexpr int screen_width = 256;
+  static constexpr int screen_height = 240;
+  static constexpr int scanline_clock_dot = 260;
+
+  // One NES palette index (0-63) per pixel
+  using framebuffer_type =
+      std::array<std::uint8_t, screen_width * screen_height>;
+
+  ppu() : m_current_scanline(-1), m_scanline_cycle(0), m_odd_frame(false) {}
+
+  // Advances the PPU by the given number of PPU cycles (dots). Any number of
+  // cycles can be processed in one call, work is done a scanline at a time:
+  // visible scanlines are rendered in one go when the PPU passes dot 256.
+  void process(int cycles) noexcept {
+    while (cycles > 0) {
+      auto remaining_in_scanline = scanline_length() - m_scanline_cycle;
+      auto step =
+          cycles < remaining_in_scanline ? cycles : remaining_in_scanline;
+      auto from = m_scanline_cycle;
+      auto to = from + step;
+      auto passes = [=](int dot) { return from <= dot && dot < to; };
+
+      if (passes(1)) {
+        // The vblank flag is set and cleared at dot 1 of its scanline
+        if (m_current_scanline == vblank_scanline) {
+          enter_vblank();
+        } else if (m_current_scanline == -1) {
+          m_status &= static_cast<std::uint8_t>(
+              ~(status_vblank | status_sprite_zero_hit | status_overflow));
+        }
+      }
+
+      if (m_current_scanline < screen_height) {
+        if (m_current_scanline >= 0 && passes(256)) {
+          render_scanline();
+        }
+        if (rendering_enabled()) {
+          if (passes(256)) {
+            increment_y();
+          }
+          if (passes(257)) {
+            // Horizontal scroll is reloaded from t for the next scanline
+            m_v = static_cast<std::uint16_t>((m_v & ~horizontal_bits) |
+                                             (m_t & horizontal_bits));
+          }
+          if (m_scanline_counter != nullptr && passes(scanline_clock_dot)) {
+            m_scanline_counter->clock_scanline();
+          }
+          if (m_current_scanline == -1 && passes(280)) {
+            m_v = static_cast<std::uint16_t>((m_v & ~vertical_bits) |
+                                             (m_t & vertical_bits));
+          }
+        }
+      }
 
-  constexpr void process(int cycles) noexcept {
-    if(m_current_scanline >= -1 && m_current_scanline < 240) // dummy and visible scanline
-    {
+      m_scanline_cycle = to;
+      cycles -= step;
 
+      if (m_scanline_cycle == scanline_length()) {
+        m_scanline_cycle = 0;
+        if (++m_current_scanline == scanlines_per_frame - 1) {
+          // Scanline 261 is the pre-render scanline, which we call -1
+          m_current_scanline = -1;
+          m_odd_frame = !m_odd_frame;
+          ++m_frame;
+        }
+      }
     }
   }
 
+  // Number of PPU cycles until the next time vblank has started, always > 0.
+  // Vblank starts while dot 1 of vblank_scanline is processed, so this counts
+  // up to the dot after it. May be one too many on odd frames, which skip a
+  // dot.
+  [[nodiscard]] constexpr int cycles_until_vblank() const noexcept {
+    constexpr auto vblank_position =
+        (vblank_scanline + 1) * dots_per_scanline + 2;
+    auto position =
+        (m_current_scanline + 1) * dots_per_scanline + m_scanline_cycle;
+    auto distance = vblank_position - position;
+    return distance > 0 ? distance : distance + dots_per_frame;
+  }
+
+  // Number of PPU cycles until the count-th next scanline clock (see
+  // scanline_counter) if rendering stays as it is, -1 if rendering is off
+  [[nodiscard]] constexpr int cycles_until_scanline_clock(
+      int count) const noexcept {
+    if (!rendering_enabled() || count <= 0) {
+      return -1;
+    }
+    auto line = m_current_scanline;
+    auto position = m_scanline_cycle;
+    auto distance = 0;
+    while (true) {
+      if (line < screen_height && position <= scanline_clock_dot) {
+        distance += scanline_clock_dot - position;
+        position = scanline_clock_dot;
+        if (--count == 0) {
+          // The clock happens while processing that dot
+          return distance + 1;
+        }
+      }
+      distance += dots_per_scanline - position;
+      position = 0;
+      line = line == scanlines_per_frame - 2 ? -1 : line + 1;
+    }
+  }
+
+  // CPU access to $2000-$2007
+  [[nodiscard]] std::uint8_t read_register(std::uint16_t address) noexcept {
+    switch (address & 0x0007U) {
+      case 0x0002: {
+        // The low bits are whatever was last on the PPU data bus
+        auto value = static_cast<std::uint8_t>((m_status & 0xE0U) |
+                                               (m_data_bus & 0x1FU));
+        m_status &= static_cast<std::uint8_t>(~status_vblank);
+        m_w = false;
+        return value;
+      }
+      case 0x0004:
+        m_data_bus = m_oam[m_oam_address];
+        break;
+      case 0x0007: {
+        auto vram_address = static_cast<std::uint16_t>(m_v & 0x3FFFU);
+        if (vram_address < vram_controller::palette_start) {
+          // Reads are delayed by one through a buffer, except palette reads
+          m_data_bus = m_read_buffer;
+          m_read_buffer = m_vram.read8(vram_address);
+        } else {
+          m_data_bus = m_vram.read8(vram_address);
+          m_read_buffer = m_vram.read8(vram_address & 0x2FFFU);
+        }
+        increment_address();
+        break;
+      }
+      default:
+        break;
+    }
+    return m_data_bus;
+  }
+
+  void write_register(std::uint16_t address, std::uint8_t value) noexcept {
+    m_data_bus = value;
+    switch (address & 0x0007U) {
+      case 0x0000: {
+        auto was_enabled = nmi_enabled();
+        m_control = value;
+        m_t = static_cast<std::uint16_t>((m_t & ~0x0C00U) |
+                                         ((value & 0x03U) << 10U));
+        // Enabling NMI during vblank fires one right away
+        if (!was_enabled && nmi_enabled() && (m_status & status_vblank) != 0) {
+          m_nmi_pending = true;
+        }
+        break;
+      }
+      case 0x0001:
+        m_mask = value;
+        break;
+      case 0x0003:
+        m_oam_address = value;
+        break;
+      case 0x0004:
+        m_oam[m_oam_address++] = value;
+        break;
+      case 0x0005:
+        if (!m_w) {
+          m_t = static_cast<std::uint16_t>((m_t & ~0x001FU) | (value >> 3U));
+          m_fine_x = value & 0x07U;
+        } else {
+          m_t = static_cast<std::uint16_t>((m_t & ~0x73E0U) |
+                                           ((value & 0x07U) << 12U) |
+                                           ((value & 0xF8U) << 2U));
+        }
+        m_w = !m_w;
+        break;
+      case 0x0006:
+        if (!m_w) {
+          m_t = static_cast<std::uint16_t>((m_t & 0x00FFU) |
+                                           ((value & 0x3FU) << 8U));
+        } else {
+          m_t = static_cast<std::uint16_t>((m_t & 0xFF00U) | value);
+          m_v = m_t;
+        }
+        m_w = !m_w;
+        break;
+      case 0x0007:
+        m_vram.write8(static_cast<std::uint16_t>(m_v & 0x3FFFU), value);
+        increment_address();
+        break;
+      default:
+        break;
+    }
+  }
+
+  // OAM DMA: the 256 bytes at data, as if written to $2004 one by one
+  void write_oam_dma(const std::uint8_t* data) noexcept {
+    // Starts at OAMADDR and wraps around back to it
+    auto first = std::size_t{sizeof(m_oam)} - m_oam_address;
+    std::memcpy(m_oam + m_oam_address, data, first);
+    std::memcpy(m_oam, data + first, m_oam_address);
+    m_data_bus = data[sizeof(m_oam) - 1];
+  }
+
+  // counter is told about every scanline clock, nullptr stops that
+  constexpr void attach(scanline_counter* counter) noexcept {
+    m_scanline_counter = counter;
+  }
+
+  void save(ppu_state& state) const noexcept {
+    state.scanline = m_current_scanline;
+    state.scanline_cycle = m_scanline_cycle;
+    state.frame = m_frame;
+    state.control = m_control;
+    state.mask = m_mask;
+    state.status = m_status;
+    state.data_bus = m_data_bus;
+    state.read_buffer = m_read_buffer;
+    state.oam_address = m_oam_address;
+    state.v = m_v;
+    state.t = m_t;
+    state.fine_x = m_fine_x;
+    state.w = m_w;
+    state.nmi_pending = m_nmi_pending;
+    state.odd_frame = m_odd_frame;
+    std::memcpy(state.oam, m_oam, sizeof(m_oam));
+    m_vram.save(state.vram);
+  }
+
+  // Everything counts as dirty afterwards
+  void load(const ppu_state& state) noexcept {
+    m_current_scanline = state.scanline;
+    m_scanline_cycle = state.scanline_cycle;
+    m_frame = state.frame;
+    m_control = state.control;
+    m_mask = state.mask;
+    m_status = state.status;
+    m_data_bus = state.data_bus;
+    m_read_buffer = state.read_buffer;
+    m_oam_address = state.oam_address;
+    m_v = state.v;
+    m_t = state.t;
+    m_fine_x = state.fine_x;
+    m_w = state.w;
+    m_nmi_pending = state.nmi_pending;
+    m_odd_frame = state.odd_frame;
+    std::memcpy(m_oam, state.oam, sizeof(m_oam));
+    m_vram.load(state.vram);
+  }
+
+  // Which 256 byte pages of ppu_state::vram were written to since the last
+  // call, one bit per page
+  [[nodiscard]] constexpr std::uint64_t take_dirty_vram() noexcept {
+    return m_vram.take_dirty_pages();
+  }
+
+  // True once after every NMI the PPU raised
+  [[nodiscard]] constexpr bool take_nmi() noexcept {
+    auto pending = m_nmi_pending;
+    m_nmi_pending = false;
+    return pending;
+  }
+
+  [[nodiscard]] constexpr auto nmi_pending() const noexcept {
+    return m_nmi_pending;
+  }
+  [[nodiscard]] constexpr auto frame() const noexcept { return m_frame; }
+  [[nodiscard]] constexpr auto scanline() const noexcept {
+    return m_current_scanline;
+  }
+  [[nodiscard]] constexpr auto scanline_cycle() const noexcept {
+    return m_scanline_cycle;
+  }
+  // The PPU address space, which mappers bank CHR and set mirroring in
+  [[nodiscard]] constexpr auto& vram() noexcept { return m_vram; }
+  // Complete once the PPU enters vblank
+  [[nodiscard]] constexpr const auto& framebuffer() const noexcept {
+    return m_framebuffer;
+  }
+
  private:
+  static constexpr std::uint8_t control_increment = 0b00000100;
+  static constexpr std::uint8_t control_sprite_table = 0b00001000;
+  static constexpr std::uint8_t control_background_table = 0b00010000;
+  static constexpr std::uint8_t control_tall_sprites = 0b00100000;
+  static constexpr std::uint8_t control_nmi = 0b10000000;
+  static constexpr std::uint8_t mask_grayscale = 0b00000001;
+  static constexpr std::uint8_t mask_background_left = 0b00000010;
+  static constexpr std::uint8_t mask_sprites_left = 0b00000100;
+  static constexpr std::uint8_t mask_background = 0b00001000;
+  static constexpr std::uint8_t mask_sprites = 0b00010000;
+  static constexpr std::uint8_t status_overflow = 0b00100000;
+  static constexpr std::uint8_t status_sprite_zero_hit = 0b01000000;
+  static constexpr std::uint8_t status_vblank = 0b10000000;
+
+  // Parts of v/t, laid out as 0yyy NNYY YYYX XXXX (fine y, nametable,
+  // coarse y, coarse x)
+  static constexpr std::uint16_t horizontal_bits = 0x041F;
+  static constexpr std::uint16_t vertical_bits = 0x7BE0;
+
+  static constexpr int sprites_per_scanline = 8;
+  // A scanline plus the partial tile scrolled in on the right
+  static constexpr int tiles_per_scanline = screen_width / 8 + 1;
+  static constexpr std::uint8_t sprite_flag_palette = 0b00000011;
+  static constexpr std::uint8_t sprite_flag_behind = 0b00100000;
+  static constexpr std::uint8_t sprite_flag_flip_x = 0b01000000;
+  static constexpr std::uint8_t sprite_flag_flip_y = 0b10000000;
+
+  [[nodiscard]] constexpr bool nmi_enabled() const noexcept {
+    return (m_control & control_nmi) != 0;
+  }
+
+  [[nodiscard]] constexpr bool rendering_enabled() const noexcept {
+    return (m_mask & (mask_background | mask_sprites)) != 0;
+  }
+
+  // The pre-render scanline of every other frame skips its last dot
+  [[nodiscard]] constexpr int scanline_length() const noexcept {
+    return m_current_scanline == -1 && m_odd_frame && rendering_enabled()
+               ? dots_per_scanline - 1
+               : dots_per_scanline;
+  }
+
+  void enter_vblank() noexcept {
+    m_status |= status_vblank;
+    if (nmi_enabled()) {
+      m_nmi_pending = true;
+    }
+  }
+
+  void increment_address() noexcept {
+    auto step = (m_control & control_increment) != 0 ? 32U : 1U;
+    m_v = static_cast<std::uint16_t>((m_v + step) & 0x7FFFU);
+  }
+
+  // Moves v one tile to the right, into the next nametable when needed
+  [[nodiscard]] static constexpr std::uint16_t next_coarse_x(
+      std::uint16_t v) noexcept {
+    if ((v & 0x001FU) == 31) {
+      return static_cast<std::uint16_t>((v & ~0x001FU) ^ 0x0400U);
+    }
+    return static_cast<std::uint16_t>(v + 1U);
+  }
+
+  void increment_y() noexcept {
+    if ((m_v & 0x7000U) != 0x7000U) {
+      m_v = static_cast<std::uint16_t>(m_v + 0x1000U);
+      return;
+    }
+
+    m_v &= static_cast<std::uint16_t>(~0x7000U);
+    auto coarse_y = (m_v & 0x03E0U) >> 5U;
+    if (coarse_y == 29) {
+      coarse_y = 0;
+      m_v ^= 0x0800U;
+    } else if (coarse_y == 31) {
+      // Out of bounds values wrap without switching nametables
+      coarse_y = 0;
+    } else {
+      ++coarse_y;
+    }
+    m_v = static_cast<std::uint16_t>((m_v & ~0x03E0U) | (coarse_y << 5U));
+  }
+
+  void render_scanline() noexcept {
+    std::uint8_t background[screen_width];
+    std::uint8_t sprites[screen_width];
+    std::uint8_t sprite_zero[screen_width];
+
+    if ((m_mask & mask_background) != 0) {
+      render_background(background);
+    } else {
+      std::memset(background, 0, sizeof(background));
+    }
+
+    std::memset(sprites, 0, sizeof(sprites));
+    std::memset(sprite_zero, 0, sizeof(sprite_zero));
+    if ((m_mask & mask_sprites) != 0) {
+      render_sprites(sprites, sprite_zero);
+    }
+
+    auto* out = m_framebuffer.data() + m_current_scanline * screen_width;
+    auto color_mask = (m_mask & mask_grayscale) != 0 ? 0x30U : 0x3FU;
+    for (auto x = 0; x < screen_width; ++x) {
+      auto background_pixel = background[x];
+      auto sprite_pixel = sprites[x];
+      auto background_opaque = (background_pixel & 0x03U) != 0;
+      auto sprite_opaque = (sprite_pixel & 0x03U) != 0;
+
+      if (sprite_zero[x] != 0 && background_opaque && x != 255) {
+        m_status |= status_sprite_zero_hit;
+      }
+
+      std::uint8_t index = 0;
+      if (sprite_opaque &&
+          (!background_opaque || (sprite_pixel & sprite_flag_behind) == 0)) {
+        index = static_cast<std::uint8_t>(0x10U | (sprite_pixel & 0x0FU));
+      } else if (background_opaque) {
+        index = background_pixel;
+      }
+      out[x] = static_cast<std::uint8_t>(m_vram.palette(index) & color_mask);
+    }
+  }
+
+  // Writes palette << 2 | pixel for every background pixel of the scanline
+  void render_background(std::uint8_t* out) noexcept {
+    // The scanline starts fine_x pixels into the first tile, so it touches
+    // tiles_per_scanline (33) of them
+    std::uint8_t pixels[tiles_per_scanline * 8];
+
+    auto table = (m_control & control_background_table) != 0 ? 0x1000U : 0U;
+    auto fine_y = (m_v >> 12U) & 0x07U;
+    auto v = m_v;
+    for (auto tile = 0; tile < tiles_per_scanline; ++tile) {
+      auto index = m_vram.nametable(v);
+      auto attribute = m_vram.nametable(0x03C0U | (v & 0x0C00U) |
+                                        ((v >> 4U) & 0x38U) |
+                                        ((v >> 2U) & 0x07U));
+      auto shift = ((v >> 4U) & 0x04U) | (v & 0x02U);
+      auto pattern = table | (static_cast<unsigned>(index) << 4U) | fine_y;
+
+      // Pixels are 0-3, so adding the palette bits to all 8 at once is safe
+      std::uint64_t row = 0;
+      std::memcpy(&row, m_vram.pattern_row(pattern), sizeof(row));
+      row |= ((attribute >> shift) & 0x03U) * 0x0404040404040404ULL;
+      std::memcpy(pixels + tile * 8, &row, sizeof(row));
+      v = next_coarse_x(v);
+    }
+    std::memcpy(out, pixels + m_fine_x, screen_width);
+
+    if ((m_mask & mask_background_left) == 0) {
+      std::memset(out, 0, 8);
+    }
+  }
+
+  // Draws the sprites on the current scanline. out gets the sprite attribute
+  // bits (priority, palette) and pixel of the frontmost opaque sprite pixel,
+  // sprite_zero is non zero where that pixel comes from sprite 0.
+  void render_sprites(std::uint8_t* out, std::uint8_t* sprite_zero) noexcept {
+    auto height = (m_control & control_tall_sprites) != 0 ? 16 : 8;
+    auto found = 0;
+    for (auto sprite = 0; sprite < 64; ++sprite) {
+      const auto* entry = &m_oam[sprite * 4];
+      // OAM holds the scanline above the sprite
+      auto row = m_current_scanline - 1 - entry[0];
+      if (row < 0 || row >= height) {
+        continue;
+      }
+      if (found == sprites_per_scanline) {
+        m_status |= status_overflow;
+        break;
+      }
+      ++found;
+
+      auto tile = entry[1];
+      auto attributes = entry[2];
+      auto x = entry[3];
+      if ((attributes & sprite_flag_flip_y) != 0) {
+        row = height - 1 - row;
+      }
+
+      unsigned pattern = 0;
+      if (height == 16) {
+        pattern = ((tile & 0x01U) << 12U) |
+                  ((tile & 0xFEU) + (row >= 8 ? 1U : 0U)) << 4U;
+      } else {
+        auto table = (m_control & control_sprite_table) != 0 ? 0x1000U : 0U;
+        pattern = table | (static_cast<unsigned>(tile) << 4U);
+      }
+      pattern |= static_cast<unsigned>(row) & 0x07U;
+
+      const auto* row_pixels = m_vram.pattern_row(pattern);
+      auto palette = static_cast<unsigned>(attributes & sprite_flag_palette)
+                     << 2U;
+      std::uint8_t pixels[8];
+      if ((attributes & sprite_flag_flip_x) != 0) {
+        for (auto i = 0; i < 8; ++i) {
+          pixels[i] = static_cast<std::uint8_t>(row_pixels[7 - i] | palette);
+        }
+      } else {
+        for (auto i = 0; i < 8; ++i) {
+          pixels[i] = static_cast<std::uint8_t>(row_pixels[i] | palette);
+        }
+      }
+      auto behind = static_cast<std::uint8_t>(attributes & sprite_flag_behind);
+      auto first = (m_mask & mask_sprites_left) == 0 ? 8 : 0;
+      for (auto i = 0; i < 8; ++i) {
+        auto column = x + i;
+        if (column < first || column >= screen_width ||
+            (pixels[i] & 0x03U) == 0 || (out[column] & 0x03U) != 0) {
+          continue;
+        }
+        out[column] = static_cast<std::uint8_t>(pixels[i] | behind);
+        sprite_zero[column] = sprite == 0 ? 1 : 0;
+      }
+    }
+  }
+
   int m_current_scanline;
-  int m_cycle_remainders;
   int m_scanline_cycle;
-  std::uint16_t m_pattern_table1;
-  std::uint16_t m_pattern_table2;
-  std::uint8_t m_palette_attribs1;
-  std::uint8_t m_palette_attribs2;
-  std::uint8_t m_memory[0x4000];
+  std::uint64_t m_frame{0};
+  std::uint8_t m_control{0};
+  std::uint8_t m_mask{0};
+  std::uint8_t m_status{0};
+  std::uint8_t m_data_bus{0};
+  std::uint8_t m_read_buffer{0};
+  std::uint8_t m_oam_address{0};
+  // Scroll and address registers. v is the current VRAM address, t the
+  // temporary address, x the fine x scroll and w the write toggle shared by
+  // $2005 and $2006.
+  std::uint16_t m_v{0};
+  std::uint16_t m_t{0};
+  std::uint8_t m_fine_x{0};
+  bool m_w{false};
+  bool m_nmi_pending{false};
   bool m_odd_frame;
+  std::uint8_t m_oam[0x100]{};
+  vram_controller m_vram;
+  scanline_counter* m_scanline_counter{nullptr};
+  framebuffer_type m_framebuffer{};
 };
 
 #endif  // NES_PPU_H
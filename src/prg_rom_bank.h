@@ -1,18 +1,21 @@
 #ifndef NES_PRG_ROM_BANK_H
 #define NES_PRG_ROM_BANK_H
 
-#include <array>
+#include <cstddef>
 #include <cstdint>
+#include "common.h"
 
+// View of one 16 KiB PRG-ROM bank inside the ROM image owned by the cartridge
 class prg_rom_bank {
  public:
-  explicit prg_rom_bank(std::array<std::uint8_t, 0x4000>& data)
-      : m_data(std::move(data)) {}
+  static constexpr std::size_t size = 0x4000;
+
+  explicit prg_rom_bank(const std::uint8_t* data) : m_data(data, size) {}
 
   [[nodiscard]] constexpr const auto& value() const noexcept { return m_data; }
 
  private:
-  std::array<std::uint8_t, 0x4000> m_data;
+  byte_span m_data;
 };
 
 #endif  // NES_PRG_ROM_BANK_H
@@ -0,0 +1,148 @@
+#ifndef NES_PROFILE_H
+#define NES_PROFILE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "opcode_info.h"
+
+// Profile policy that compiles away completely. cpu2a03 checks
+// Profile::enabled with if constexpr, so record() is never even called.
+class null_profile {
+ public:
+  static constexpr bool enabled = false;
+
+  constexpr void record(std::uint16_t, std::uint8_t, int) noexcept {}
+};
+
+// Profile policy counting executions and cycles per opcode and per address
+// of every instruction. Addresses are CPU addresses, so with bank switching
+// all banks mapped at an address share its counters.
+class instruction_profile {
+ public:
+  static constexpr bool enabled = true;
+
+  instruction_profile()
+      : m_address_hits(std::make_unique<std::uint64_t[]>(address_count)),
+        m_address_cycles(std::make_unique<std::uint64_t[]>(address_count)),
+        m_address_opcodes(std::make_unique<std::uint8_t[]>(address_count)) {}
+
+  void record(std::uint16_t pc, std::uint8_t opcode, int cycles) noexcept {
+    auto taken = static_cast<std::uint64_t>(cycles);
+    ++m_opcode_hits[opcode];
+    m_opcode_cycles[opcode] += taken;
+    ++m_address_hits[pc];
+    m_address_cycles[pc] += taken;
+    m_address_opcodes[pc] = opcode;
+    m_total_cycles += taken;
+  }
+
+  [[nodiscard]] auto opcode_hits(std::uint8_t opcode) const noexcept {
+    return m_opcode_hits[opcode];
+  }
+  [[nodiscard]] auto opcode_cycles(std::uint8_t opcode) const noexcept {
+    return m_opcode_cycles[opcode];
+  }
+  [[nodiscard]] auto address_hits(std::uint16_t address) const noexcept {
+    return m_address_hits[address];
+  }
+  [[nodiscard]] auto address_cycles(std::uint16_t address) const noexcept {
+    return m_address_cycles[address];
+  }
+  // Last opcode executed at address
+  [[nodiscard]] auto address_opcode(std::uint16_t address) const noexcept {
+    return m_address_opcodes[address];
+  }
+  // Cycles spent in instructions, interrupt entry is not counted
+  [[nodiscard]] auto total_cycles() const noexcept { return m_total_cycles; }
+
+ private:
+  static constexpr std::size_t address_count = 0x10000;
+
+  std::uint64_t m_opcode_hits[0x100]{};
+  std::uint64_t m_opcode_cycles[0x100]{};
+  std::unique_ptr<std::uint64_t[]> m_address_hits;
+  std::unique_ptr<std::uint64_t[]> m_address_cycles;
+  std::unique_ptr<std::uint8_t[]> m_address_opcodes;
+  std::uint64_t m_total_cycles{0};
+};
+
+// Writes a gprof style flat profile: opcodes and then instruction addresses
+// sorted by the cycles spent in them, at most limit lines each.
+void write_flat_profile(std::FILE* file,
+                        const instruction_profile& profile,
+                        std::size_t limit = 50) {
+  auto total = static_cast<double>(
+      std::max<std::uint64_t>(profile.total_cycles(), 1));
+
+  std::vector<std::uint8_t> opcodes;
+  for (auto opcode = 0U; opcode < 0x100; ++opcode) {
+    if (profile.opcode_hits(static_cast<std::uint8_t>(opcode)) > 0) {
+      opcodes.push_back(static_cast<std::uint8_t>(opcode));
+    }
+  }
+  std::sort(opcodes.begin(), opcodes.end(), [&](auto a, auto b) {
+    return profile.opcode_cycles(a) > profile.opcode_cycles(b);
+  });
+
+  std::fprintf(file, "  %%   cumulative      cycles        calls  opcode\n");
+  double cumulative = 0;
+  for (std::size_t i = 0; i < opcodes.size() && i < limit; ++i) {
+    auto cycles = static_cast<double>(profile.opcode_cycles(opcodes[i]));
+    cumulative += cycles;
+    std::fprintf(file, "%6.2f %8.2f %14llu %12llu  $%02X %s\n",
+                 100 * cycles / total, 100 * cumulative / total,
+                 static_cast<unsigned long long>(
+                     profile.opcode_cycles(opcodes[i])),
+                 static_cast<unsigned long long>(
+                     profile.opcode_hits(opcodes[i])),
+                 opcodes[i], opcode_infos[opcodes[i]].mnemonic);
+  }
+
+  std::vector<std::uint16_t> addresses;
+  for (auto address = 0U; address < 0x10000; ++address) {
+    if (profile.address_hits(static_cast<std::uint16_t>(address)) > 0) {
+      addresses.push_back(static_cast<std::uint16_t>(address));
+    }
+  }
+  std::sort(addresses.begin(), addresses.end(), [&](auto a, auto b) {
+    return profile.address_cycles(a) > profile.address_cycles(b);
+  });
+
+  std::fprintf(file,
+               "\n  %%   cumulative      cycles        calls  address  "
+               "opcode\n");
+  cumulative = 0;
+  for (std::size_t i = 0; i < addresses.size() && i < limit; ++i) {
+    auto cycles = static_cast<double>(profile.address_cycles(addresses[i]));
+    cumulative += cycles;
+    auto opcode = profile.address_opcode(addresses[i]);
+    std::fprintf(file, "%6.2f %8.2f %14llu %12llu  $%04X    $%02X %s\n",
+                 100 * cycles / total, 100 * cumulative / total,
+                 static_cast<unsigned long long>(
+                     profile.address_cycles(addresses[i])),
+                 static_cast<unsigned long long>(
+                     profile.address_hits(addresses[i])),
+                 addresses[i], opcode, opcode_infos[opcode].mnemonic);
+  }
+}
+
+// Writes a symbol for every executed instruction in the format of the
+// /tmp/perf-<pid>.map files perf reads for JIT code ("<start> <size>
+// <name>", hex), with 6502 addresses as the addresses. Tools that take such
+// maps can then attribute samples or counts given as 6502 addresses.
+void write_perf_map(std::FILE* file, const instruction_profile& profile) {
+  for (auto address = 0U; address < 0x10000; ++address) {
+    auto pc = static_cast<std::uint16_t>(address);
+    if (profile.address_hits(pc) > 0) {
+      auto opcode = profile.address_opcode(pc);
+      std::fprintf(file, "%x %x nes_%04X_%s\n", address,
+                   opcode_infos[opcode].length, address,
+                   opcode_infos[opcode].mnemonic);
+    }
+  }
+}
+
+#endif  // NES_PROFILE_H
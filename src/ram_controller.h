@@ -1,69 +1,249 @@
 #ifndef NES_RAM_CONTROLLER_H
 #define NES_RAM_CONTROLLER_H
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include "common.h"
 #include "prg_rom_bank.h"
 
+// What lives behind a 256 byte page of the CPU address space. Only pages
+// without a host pointer in the page tables look at this.
+enum class page_type : std::uint8_t {
+  memory,
+  ppu_registers,
+  apu_io_registers,
+  cartridge,
+  unmapped
+};
+
+// Contents of everything ram_controller stores itself, see save_state.h
+struct memory_state {
+  std::uint8_t ram[0x0800];
+  std::uint8_t prg_ram[0x2000];
+  std::uint8_t ppu_registers[0x0008];
+  std::uint8_t apu_io_registers[0x0020];
+};
+
+// Something that handles the accesses to one of the page types above, like
+// the PPU registers. Called for every access to such a page, so it should
+// keep the work it does cheap.
+class io_device {
+ public:
+  virtual ~io_device() = default;
+
+  [[nodiscard]] virtual std::uint8_t read_io(std::uint16_t address) = 0;
+  virtual void write_io(std::uint16_t address, std::uint8_t value) = 0;
+};
+
 class ram_controller {
- private:
-  // Returns true if address is within the range $0000-$1FFF
-  [[nodiscard]] constexpr auto is_lower_ram_range(std::uint16_t address) const
-      noexcept {
-    return (address & 0x1FFFU) == address;
+ public:
+  static constexpr unsigned dirty_prg_ram_shift = 8;
+
+  ram_controller() noexcept {
+    for (std::size_t page = 0; page < page_count; ++page) {
+      if (page < 0x20) {
+        // Address range $0000-$07FF is mirrored 3 times
+        map_memory(page, &m_ram[(page << page_bits) & 0x07FFU]);
+      } else if (page < 0x40) {
+        // Address range $2000-$2007 is mirrored multiple times
+        m_page_types[page] = page_type::ppu_registers;
+      } else if (page == 0x40) {
+        m_page_types[page] = page_type::apu_io_registers;
+      } else if (page < 0x60) {
+        // Expansion area, nothing is connected here without a mapper
+        m_page_types[page] = page_type::unmapped;
+      } else if (page < 0x80) {
+        map_memory(page, &m_prg_ram[(page << page_bits) - 0x6000U]);
+      } else {
+        // PRG-ROM is unmapped until a bank is loaded, writes always go to the
+        // cartridge
+        m_page_types[page] = page_type::cartridge;
+      }
+    }
   }
 
-  [[nodiscard]] constexpr auto is_io_mirror_range(std::uint16_t address) const
+  ram_controller(const ram_controller&) = delete;
+  ram_controller& operator=(const ram_controller&) = delete;
+
+  [[nodiscard]] /*constexpr*/ std::uint8_t read8(std::uint16_t address) const
       noexcept {
-    return (address & 0x3FFFU) == address;
+    const auto* page = m_read_pages[address >> page_bits];
+    if (page != nullptr) {
+      return page[address & page_mask];
+    }
+    return read_slow(address);
+  }
+
+  // Host memory backing the 256 byte page at page * $100, or nullptr if
+  // reading it has side effects (registers) or nothing is mapped there
+  [[nodiscard]] constexpr const std::uint8_t* page_data(
+      std::uint8_t page) const noexcept {
+    return m_read_pages[page];
   }
 
-  [[nodiscard]] constexpr auto translate_address(std::uint16_t address) const
+  [[nodiscard]] /*constexpr*/ auto read16(std::uint16_t address) const
       noexcept {
-    if (is_lower_ram_range(address)) {
-      // Address range $0000-$07FF is mirrored 3 times
-      address = address & 0x07FFU;
-    } else if (is_io_mirror_range((address))) {
-      // Address range $2000-$2007 is mirrored multiple times
+    return static_cast<std::uint16_t>(
+        read8(address) |
+        static_cast<std::uint16_t>(
+            read8(static_cast<std::uint16_t>(address + 1U)) << 8U));
+  }
 
-      address = address & 0x2007U;
+  /*constexpr*/ void write8(std::uint16_t address, std::uint8_t value) noexcept {
+    auto* page = m_write_pages[address >> page_bits];
+    if (page != nullptr) {
+      page[address & page_mask] = value;
+      m_dirty_pages[address >> page_bits] = 1;
+      return;
     }
+    write_slow(address, value);
+  }
 
-    return address;
+  // Makes size bytes of PRG-ROM starting at data visible at address. Nothing
+  // is copied, data must stay alive for as long as it is mapped. Both address
+  // and size must be multiples of the page size.
+  void map_prg_rom(std::uint16_t address,
+                   const std::uint8_t* data,
+                   std::size_t size) noexcept {
+    auto first_page = std::size_t{address} >> page_bits;
+    for (std::size_t i = 0; i < (size >> page_bits); ++i) {
+      m_read_pages[first_page + i] = data + (i << page_bits);
+    }
   }
 
-  std::uint8_t m_memory[0xFFFF];
+  void load_prg_bank1(const prg_rom_bank& rom) noexcept {
+    map_prg_rom(0x8000, rom.value().data(), rom.value().size());
+  }
 
- public:
-  [[nodiscard]] constexpr auto read8(std::uint16_t address) const noexcept {
-    return m_memory[translate_address(address)];
+  void load_prg_bank2(const prg_rom_bank& rom) noexcept {
+    map_prg_rom(0xC000, rom.value().data(), rom.value().size());
   }
-  [[nodiscard]] constexpr auto read16(std::uint16_t address) const noexcept {
-    // I will assume that we will never attempt to read 16bit that crosses the
-    // border of two ranges i.e the range that (address) occupies is not the
-    // same as (address+1). Otherwise I would have to do
-    // translate_address(address) AND translate_address(address+1)
-    address = translate_address(address);
 
-    return static_cast<std::uint16_t>(
-        m_memory[address] |
-        static_cast<std::uint16_t>(m_memory[address + 1] << 8U));
+  // Routes all accesses to pages of the given type to device, or back to
+  // plain register storage if device is nullptr. device must outlive the
+  // ram_controller or be detached first.
+  void attach(page_type type, io_device* device) noexcept {
+    m_devices[static_cast<std::size_t>(type)] = device;
   }
 
-  constexpr void write8(std::uint16_t address, std::uint8_t value) noexcept {
-      address = translate_address(address);
+  void save(memory_state& state) const noexcept {
+    std::memcpy(state.ram, m_ram, sizeof(m_ram));
+    std::memcpy(state.prg_ram, m_prg_ram, sizeof(m_prg_ram));
+    std::memcpy(state.ppu_registers, m_ppu_registers,
+                sizeof(m_ppu_registers));
+    std::memcpy(state.apu_io_registers, m_apu_io_registers,
+                sizeof(m_apu_io_registers));
+  }
 
-    m_memory[address] = value;
+  // Only restores memory contents, the page map stays as it is. Everything
+  // counts as dirty afterwards.
+  void load(const memory_state& state) noexcept {
+    m_dirty_pages.fill(1);
+    std::memcpy(m_ram, state.ram, sizeof(m_ram));
+    std::memcpy(m_prg_ram, state.prg_ram, sizeof(m_prg_ram));
+    std::memcpy(m_ppu_registers, state.ppu_registers,
+                sizeof(m_ppu_registers));
+    std::memcpy(m_apu_io_registers, state.apu_io_registers,
+                sizeof(m_apu_io_registers));
   }
 
-  void load_prg_bank1(const prg_rom_bank& rom) {
-    std::memcpy(&m_memory[0x8000], rom.value().data(), 0x4000);
+  // Which 256 byte pages of memory_state were written to since the last
+  // call: bit n for page n of ram, bit dirty_prg_ram_shift + n for page n of
+  // prg_ram. Registers are not tracked.
+  [[nodiscard]] std::uint64_t take_dirty_pages() noexcept {
+    std::uint64_t dirty = 0;
+    for (std::size_t page = 0x00; page < 0x20; ++page) {
+      dirty |= std::uint64_t{m_dirty_pages[page]} << (page & 0x07U);
+    }
+    for (std::size_t page = 0x60; page < 0x80; ++page) {
+      dirty |= std::uint64_t{m_dirty_pages[page]}
+               << (dirty_prg_ram_shift + page - 0x60);
+    }
+    m_dirty_pages.fill(0);
+    return dirty;
   }
 
-  void load_prg_bank2(const prg_rom_bank& rom) {
-    std::memcpy(&m_memory[0xC000], rom.value().data(), 0x4000);
+  // The 2 KiB of internal RAM at $0000-$07FF
+  [[nodiscard]] constexpr byte_span ram() const noexcept {
+    return byte_span{m_ram, sizeof(m_ram)};
   }
+
+ private:
+  static constexpr unsigned page_bits = 8;
+  static constexpr std::size_t page_count = 0x10000U >> page_bits;
+  static constexpr unsigned page_mask = (1U << page_bits) - 1;
+
+  void map_memory(std::size_t page, std::uint8_t* memory) noexcept {
+    m_read_pages[page] = memory;
+    m_write_pages[page] = memory;
+    m_page_types[page] = page_type::memory;
+  }
+
+  [[nodiscard]] std::uint8_t read_slow(std::uint16_t address) const noexcept {
+    auto type = m_page_types[address >> page_bits];
+    if (auto* device = m_devices[static_cast<std::size_t>(type)]) {
+      return device->read_io(address);
+    }
+
+    switch (type) {
+      case page_type::ppu_registers:
+        return m_ppu_registers[address & 0x0007U];
+      case page_type::apu_io_registers:
+        if (address < 0x4020) {
+          return m_apu_io_registers[address & 0x001FU];
+        }
+        return 0;
+      case page_type::memory:
+      case page_type::cartridge:
+      case page_type::unmapped:
+        break;
+    }
+    // Open bus is not emulated
+    return 0;
+  }
+
+  void write_slow(std::uint16_t address, std::uint8_t value) noexcept {
+    auto type = m_page_types[address >> page_bits];
+    if (auto* device = m_devices[static_cast<std::size_t>(type)]) {
+      device->write_io(address, value);
+      return;
+    }
+
+    switch (type) {
+      case page_type::ppu_registers:
+        m_ppu_registers[address & 0x0007U] = value;
+        break;
+      case page_type::apu_io_registers:
+        if (address < 0x4020) {
+          m_apu_io_registers[address & 0x001FU] = value;
+        }
+        break;
+      case page_type::cartridge:
+        // PRG-ROM is read only, mapper registers are an attached device
+      case page_type::memory:
+      case page_type::unmapped:
+        break;
+    }
+  }
+
+  // Host memory backing each page for reads and writes respectively, nullptr
+  // if accesses need to go through read_slow() / write_slow()
+  std::array<const std::uint8_t*, page_count> m_read_pages{};
+  std::array<std::uint8_t*, page_count> m_write_pages{};
+  std::array<page_type, page_count> m_page_types{};
+  std::array<io_device*, static_cast<std::size_t>(page_type::unmapped) + 1>
+      m_devices{};
+  // Non zero for every page written through the page tables since the last
+  // take_dirty_pages(), indexed like the page tables
+  std::array<std::uint8_t, page_count> m_dirty_pages{};
+
+  std::uint8_t m_ram[0x0800]{};
+  std::uint8_t m_prg_ram[0x2000]{};
+  // Plain storage for the I/O registers until the devices behind them exist
+  std::uint8_t m_ppu_registers[0x0008]{};
+  std::uint8_t m_apu_io_registers[0x0020]{};
 };
 
 #endif  // NES_RAM_CONTROLLER_H
@@ -0,0 +1,77 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "hash.h"
+#include "recompiler.h"
+#include "rom_loader.h"
+#include "scheduler.h"
+
+// Recompiles the PRG-ROM of an NROM cartridge to C++ ahead of time, see
+// recompiler.h. The output is meant to be built into nes_headless with the
+// NES_RECOMPILE_ROM CMake option, which runs this as part of the build.
+//
+// usage: nes_recompile <rom> <output> [--entry <hex address>]...
+//
+// Code is followed from the NMI, reset and IRQ vectors, and from every
+// --entry, for code that is only reached through indirect jumps.
+int main(int argc, char** argv) {
+  auto usage = [&] {
+    std::cerr << "usage: " << argv[0]
+              << " <rom> <output> [--entry <hex address>]...\n";
+    return 1;
+  };
+  if (argc < 3 || argc % 2 == 0) {
+    return usage();
+  }
+
+  std::vector<std::uint16_t> extra_entries;
+  for (auto i = 3; i < argc; i += 2) {
+    char* end = nullptr;
+    auto address = std::strtoul(argv[i + 1], &end, 16);
+    if (std::string{argv[i]} != "--entry" || *argv[i + 1] == '\0' ||
+        *end != '\0' || address > 0xFFFF) {
+      return usage();
+    }
+    extra_entries.push_back(static_cast<std::uint16_t>(address));
+  }
+
+  rom_error error{};
+  auto rom = load_rom(argv[1], error);
+  if (!rom) {
+    std::cerr << "Unable to load ROM: " << rom_error_message(error) << '\n';
+    return 1;
+  }
+  if (rom->header().mapper != 0) {
+    std::cerr << "Only NROM (mapper 0) cartridges can be recompiled, this is "
+                 "mapper "
+              << rom->header().mapper << '\n';
+    return 1;
+  }
+
+  // A console maps PRG-ROM exactly like it will be when the code runs
+  auto nes = std::make_unique<scheduler<>>(std::move(*rom));
+  const auto& memory = nes->memory();
+  std::vector<std::uint16_t> entries{memory.read16(0xFFFA),
+                                     memory.read16(0xFFFC),
+                                     memory.read16(0xFFFE)};
+  entries.insert(entries.end(), extra_entries.begin(), extra_entries.end());
+  auto blocks = find_basic_blocks(memory, entries);
+
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> file{
+      std::fopen(argv[2], "w"), &std::fclose};
+  if (!file) {
+    std::cerr << "Unable to write " << argv[2] << '\n';
+    return 1;
+  }
+  write_recompiled_program(file.get(), blocks,
+                           fnv1a_64(nes->cart().prg_rom_data()), argv[1]);
+
+  std::size_t instructions = 0;
+  for (const auto& block : blocks) {
+    instructions += block.instructions.size();
+  }
+  std::printf("%zu blocks, %zu instructions\n", blocks.size(), instructions);
+}
@@ -0,0 +1,46 @@
+#ifndef NES_RECOMPILED_H
+#define NES_RECOMPILED_H
+
+#include <cstdint>
+#include "cpu_registers.h"
+#include "opcode_table.h"
+#include "ram_controller.h"
+
+// Runtime side of PRG-ROM recompiled ahead of time by nes_recompile, see
+// recompiler.h.
+//
+// Every basic block the recompiler found is a C++ function that runs its
+// instructions one after the other through the same opcode:: functions the
+// interpreter dispatches to, but as direct calls the compiler can inline,
+// without decoding or looking anything up. A block adds the cycles of every
+// instruction as it goes, so memory mapped registers see the same cycle
+// counts as with the interpreter, and returns early once cycles reaches end,
+// which the scheduler may pull in from a register write.
+using recompiled_block = void (*)(cpu_registers& regs,
+                                  ram_controller& mem,
+                                  std::uint64_t& cycles,
+                                  const std::uint64_t& end) noexcept;
+
+// The output of nes_recompile for one ROM
+struct recompiled_program {
+  // fnv1a_64() of the PRG-ROM it was recompiled from, it is useless for
+  // anything else
+  std::uint64_t prg_rom_hash;
+  // The block starting at each address in $8000-$FFFF, nullptr where the
+  // interpreter has to run the code instead
+  const recompiled_block* blocks;
+};
+
+// Runs the instruction at pc with the given opcode, like
+// cpu2a03::process_instruction() does
+template <std::uint8_t Opcode>
+void recompiled_step(cpu_registers& regs,
+                     ram_controller& mem,
+                     std::uint64_t& cycles,
+                     std::uint16_t pc) noexcept {
+  constexpr auto handler = opcode::handlers[Opcode];
+  regs.set_pc(static_cast<std::uint16_t>(pc + 1U));
+  cycles += static_cast<std::uint64_t>(handler(regs, mem));
+}
+
+#endif  // NES_RECOMPILED_H
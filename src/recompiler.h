@@ -0,0 +1,199 @@
+#ifndef NES_RECOMPILER_H
+#define NES_RECOMPILER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "disassembler.h"
+#include "opcode_info.h"
+#include "ram_controller.h"
+
+// Static recompilation of PRG-ROM that never moves (NROM) to C++, the build
+// time side of recompiled.h.
+//
+// find_basic_blocks() follows the code reachable from a set of entry points,
+// normally the interrupt vectors, through branches, jumps and subroutine
+// calls. Indirect jumps, returns from interrupts and anything computed at
+// run time are not followed: code only reached that way is left to the
+// interpreter, which runs until it reaches the start of a block again.
+// write_recompiled_program() then writes every block as a function of
+// recompiled_step() calls.
+
+struct basic_block {
+  std::uint16_t start;
+  std::vector<disassembled_instruction> instructions;
+};
+
+namespace recompiler_detail {
+
+// What an instruction does to the flow of control
+enum class flow {
+  // Continues with the next instruction
+  next,
+  // Continues with either the next instruction or the operand
+  branch,
+  // Continues at the operand, and the next instruction once it returns
+  call,
+  // Continues at the operand
+  jump,
+  // Continues somewhere only known at run time, or nowhere (JAM)
+  unknown,
+};
+
+[[nodiscard]] constexpr flow instruction_flow(std::uint8_t opcode) noexcept {
+  switch (opcode) {
+    case 0x20:  // JSR
+      return flow::call;
+    case 0x4C:  // JMP absolute
+      return flow::jump;
+    case 0x00:  // BRK
+    case 0x40:  // RTI
+    case 0x60:  // RTS
+    case 0x6C:  // JMP indirect
+      return flow::unknown;
+    default:
+      break;
+  }
+  const auto& info = opcode_infos[opcode];
+  if (info.mode == addressing_mode::relative) {
+    return flow::branch;
+  }
+  if (info.mnemonic[0] == 'J' && info.mnemonic[1] == 'A') {
+    return flow::unknown;
+  }
+  return flow::next;
+}
+
+[[nodiscard]] disassembled_instruction decode(const ram_controller& memory,
+                                              std::uint32_t address) noexcept {
+  disassembled_instruction instruction{};
+  static_cast<void>(disassemble(memory, static_cast<std::uint16_t>(address),
+                                address + 1, &instruction, 1));
+  return instruction;
+}
+
+}  // namespace recompiler_detail
+
+// Finds the basic blocks of the code in $8000-$FFFF reachable from entries,
+// sorted by address. Blocks start at entries, branch, jump and call targets,
+// and the instructions after branches and calls. They end after the first
+// instruction that changes the flow of control, or before the start of the
+// next block. Code jumped into the middle of is decoded from there on, so
+// blocks can overlap.
+[[nodiscard]] std::vector<basic_block> find_basic_blocks(
+    const ram_controller& memory,
+    const std::vector<std::uint16_t>& entries) {
+  using namespace recompiler_detail;
+  constexpr std::uint32_t first_address = 0x8000;
+  constexpr std::uint32_t address_count = 0x10000;
+
+  std::vector<bool> leader(address_count);
+  std::vector<bool> followed(address_count);
+  std::vector<std::uint32_t> pending;
+  auto add_leader = [&](std::uint32_t address) {
+    if (address >= first_address && address < address_count) {
+      leader[address] = true;
+      pending.push_back(address);
+    }
+  };
+  for (auto entry : entries) {
+    add_leader(entry);
+  }
+
+  while (!pending.empty()) {
+    auto address = pending.back();
+    pending.pop_back();
+    while (address < address_count && !followed[address]) {
+      followed[address] = true;
+      auto instruction = decode(memory, address);
+      auto next = address + instruction.info().length;
+      auto kind = instruction_flow(instruction.opcode);
+      if (kind == flow::next) {
+        address = next;
+        continue;
+      }
+      if (kind != flow::unknown) {
+        add_leader(instruction.operand());
+      }
+      if (kind == flow::branch || kind == flow::call) {
+        add_leader(next);
+      }
+      break;
+    }
+  }
+
+  std::vector<basic_block> blocks;
+  for (auto start = first_address; start < address_count; ++start) {
+    if (!leader[start]) {
+      continue;
+    }
+    basic_block block{static_cast<std::uint16_t>(start), {}};
+    auto address = start;
+    do {
+      auto instruction = decode(memory, address);
+      block.instructions.push_back(instruction);
+      address += instruction.info().length;
+      if (instruction_flow(instruction.opcode) != flow::next) {
+        break;
+      }
+    } while (address < address_count && !leader[address]);
+    blocks.push_back(std::move(block));
+  }
+  return blocks;
+}
+
+// Writes blocks as C++ to be #included into a single translation unit,
+// defining recompiled_code::program (see recompiled.h) for the PRG-ROM
+// whose fnv1a_64() is prg_rom_hash
+void write_recompiled_program(std::FILE* file,
+                              const std::vector<basic_block>& blocks,
+                              std::uint64_t prg_rom_hash,
+                              const char* source) {
+  std::fprintf(file,
+               "// Generated by nes_recompile from %s, do not edit.\n"
+               "// See recompiler.h.\n\n"
+               "#include <array>\n"
+               "#include \"recompiled.h\"\n\n"
+               "namespace recompiled_code {\n",
+               source);
+
+  for (const auto& block : blocks) {
+    auto count = block.instructions.size();
+    std::fprintf(file,
+                 "\nvoid block_%04X(cpu_registers& regs,\n"
+                 "                ram_controller& mem,\n"
+                 "                std::uint64_t& cycles,\n"
+                 "                const std::uint64_t& %s) noexcept {\n",
+                 block.start, count > 1 ? "end" : "/*end*/");
+    for (std::size_t i = 0; i < count; ++i) {
+      const auto& instruction = block.instructions[i];
+      char text[max_instruction_text];
+      format_instruction(instruction, text);
+      if (i > 0) {
+        std::fprintf(file, "  if (cycles >= end) {\n    return;\n  }\n");
+      }
+      std::fprintf(file,
+                   "  recompiled_step<0x%02X>(regs, mem, cycles, 0x%04X);"
+                   "  // %s\n",
+                   instruction.opcode, instruction.address, text);
+    }
+    std::fprintf(file, "}\n");
+  }
+
+  std::fprintf(file,
+               "\nconstexpr std::array<recompiled_block, 0x8000> blocks = "
+               "[] {\n"
+               "  std::array<recompiled_block, 0x8000> table{};\n");
+  for (const auto& block : blocks) {
+    std::fprintf(file, "  table[0x%04X] = &block_%04X;\n",
+                 block.start - 0x8000U, block.start);
+  }
+  std::fprintf(file,
+               "  return table;\n"
+               "}();\n\n"
+               "const recompiled_program program{0x%016llXULL, blocks.data()};"
+               "\n\n}  // namespace recompiled_code\n",
+               static_cast<unsigned long long>(prg_rom_hash));
+}
+
+#endif  // NES_RECOMPILER_H
@@ -0,0 +1,422 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include "opcode_info.h"
+#include "opcode_table.h"
+#include "rewind_buffer.h"
+#include "rom_loader.h"
+#include "save_state.h"
+#include "scheduler.h"
+
+// Regression checks for bugs that nestest does not catch, each running a
+// tiny ROM assembled here. Exits with 0 if every check passed, and otherwise
+// prints the ones that failed.
+//
+// usage: nes_regression
+
+namespace {
+
+// An iNES image with 16 KiB PRG-ROM units and 8 KiB CHR-ROM units
+struct test_rom {
+  std::uint8_t mapper{0};
+  std::vector<std::uint8_t> prg = std::vector<std::uint8_t>(0x4000);
+  std::vector<std::uint8_t> chr = std::vector<std::uint8_t>(0x2000);
+
+  // Assembles bytes at address, which is in the last PRG-ROM bank
+  void put(std::uint16_t address, std::vector<std::uint8_t> bytes) {
+    auto offset = prg.size() - 0x10000U + address;
+    for (auto byte : bytes) {
+      prg[offset++] = byte;
+    }
+  }
+
+  void set_vectors(std::uint16_t nmi, std::uint16_t reset, std::uint16_t irq) {
+    put(0xFFFA, {static_cast<std::uint8_t>(nmi & 0xFFU),
+                 static_cast<std::uint8_t>(nmi >> 8U),
+                 static_cast<std::uint8_t>(reset & 0xFFU),
+                 static_cast<std::uint8_t>(reset >> 8U),
+                 static_cast<std::uint8_t>(irq & 0xFFU),
+                 static_cast<std::uint8_t>(irq >> 8U)});
+  }
+
+  // Writes the image to a temporary file and loads it from there
+  [[nodiscard]] std::optional<cartridge> load() const {
+    std::vector<std::uint8_t> image{
+        'N',
+        'E',
+        'S',
+        0x1A,
+        static_cast<std::uint8_t>(prg.size() / 0x4000),
+        static_cast<std::uint8_t>(chr.size() / 0x2000),
+        static_cast<std::uint8_t>((mapper & 0x0FU) << 4U),
+        static_cast<std::uint8_t>(mapper & 0xF0U)};
+    image.resize(16);
+    image.insert(image.end(), prg.begin(), prg.end());
+    image.insert(image.end(), chr.begin(), chr.end());
+
+    char path[] = "/tmp/nes_regression_XXXXXX";
+    auto fd = ::mkstemp(path);
+    if (fd < 0) {
+      return std::nullopt;
+    }
+    auto written = ::write(fd, image.data(), image.size());
+    ::close(fd);
+    rom_error error{};
+    auto rom = written == static_cast<ssize_t>(image.size())
+                   ? load_rom(path, error)
+                   : std::nullopt;
+    // The mapping keeps the contents alive
+    ::unlink(path);
+    return rom;
+  }
+};
+
+// Every vblank with NMI enabled has to deliver exactly one NMI, also when a
+// batch of the scheduler ends right on the dot vblank starts at
+bool nmi_every_frame() {
+  test_rom rom;
+  rom.put(0xC000, {
+                      0x78,              // SEI
+                      0xA9, 0x80,        // LDA #$80
+                      0x8D, 0x00, 0x20,  // STA $2000
+                      0x4C, 0x06, 0xC0,  // JMP $C006
+                  });
+  rom.put(0xC100, {
+                      0xE6, 0x00,  // INC $00
+                      0xD0, 0x02,  // BNE $C106
+                      0xE6, 0x01,  // INC $01
+                      0x40,        // RTI
+                  });
+  rom.set_vectors(0xC100, 0xC000, 0xC106);
+  auto cart = rom.load();
+  if (!cart) {
+    std::printf("nmi_every_frame: unable to load the ROM\n");
+    return false;
+  }
+
+  auto nes = std::make_unique<scheduler<>>(std::move(*cart));
+  nes->reset();
+  constexpr unsigned frames = 600;
+  for (unsigned frame = 0; frame < frames; ++frame) {
+    if (!nes->run_frame()) {
+      std::printf("nmi_every_frame: frame %u did not reach vblank\n", frame);
+      return false;
+    }
+  }
+  // The handler for the last NMI has not run yet
+  auto ram = nes->memory().ram();
+  auto nmis = ram[0] | ram[1] << 8U;
+  if (nmis != frames - 1) {
+    std::printf("nmi_every_frame: %u NMIs in %u frames, expected %u\n", nmis,
+                frames, frames - 1);
+    return false;
+  }
+  return true;
+}
+
+// Keeps changing RAM from the main loop, and RAM and a nametable from the
+// NMI handler, so that every frame differs from the one before
+std::unique_ptr<scheduler<>> busy_console() {
+  test_rom rom;
+  rom.put(0xC000, {
+                      0x78,              // SEI
+                      0xA9, 0x80,        // LDA #$80
+                      0x8D, 0x00, 0x20,  // STA $2000
+                      0xEE, 0x00, 0x04,  // INC $0400
+                      0x4C, 0x06, 0xC0,  // JMP $C006
+                  });
+  rom.put(0xC100, {
+                      0xE6, 0x00,        // INC $00
+                      0xA9, 0x20,        // LDA #$20
+                      0x8D, 0x06, 0x20,  // STA $2006
+                      0xA5, 0x00,        // LDA $00
+                      0x8D, 0x06, 0x20,  // STA $2006
+                      0x8D, 0x07, 0x20,  // STA $2007
+                      0x40,              // RTI
+                  });
+  rom.set_vectors(0xC100, 0xC000, 0xC000);
+  auto cart = rom.load();
+  if (!cart) {
+    return nullptr;
+  }
+  auto nes = std::make_unique<scheduler<>>(std::move(*cart));
+  nes->reset();
+  return nes;
+}
+
+bool same_state(const save_state& a, const save_state& b) {
+  return std::memcmp(&a, &b, sizeof(save_state)) == 0;
+}
+
+// Loading a save state continues exactly like the console it was taken
+// from, and a state from another build is refused without touching it
+bool save_state_round_trip() {
+  auto nes = busy_console();
+  if (!nes) {
+    std::printf("save_state_round_trip: unable to load the ROM\n");
+    return false;
+  }
+
+  auto saved = std::make_unique<save_state>();
+  auto expected = std::make_unique<save_state>();
+  auto actual = std::make_unique<save_state>();
+  for (auto frame = 0; frame < 30; ++frame) {
+    static_cast<void>(nes->run_frame());
+  }
+  nes->save(*saved);
+  for (auto frame = 0; frame < 60; ++frame) {
+    static_cast<void>(nes->run_frame());
+  }
+  nes->save(*expected);
+
+  auto stale = std::make_unique<save_state>(*saved);
+  ++stale->header.version;
+  if (nes->load(*stale)) {
+    std::printf("save_state_round_trip: loaded a state of another version\n");
+    return false;
+  }
+  nes->save(*actual);
+  if (!same_state(*actual, *expected)) {
+    std::printf("save_state_round_trip: a refused load changed the state\n");
+    return false;
+  }
+
+  if (!nes->load(*saved)) {
+    std::printf("save_state_round_trip: refused its own state\n");
+    return false;
+  }
+  for (auto frame = 0; frame < 60; ++frame) {
+    static_cast<void>(nes->run_frame());
+  }
+  nes->save(*actual);
+  if (!same_state(*actual, *expected)) {
+    std::printf("save_state_round_trip: diverged after loading\n");
+    return false;
+  }
+  return true;
+}
+
+// Every rewind() restores the snapshot pushed before the newest one, also
+// once the oldest deltas had to be dropped for lack of space
+bool rewind_restores_snapshots() {
+  constexpr auto frames = 20;
+  // The deltas of busy_console() are around 90 bytes each, so only the
+  // larger buffer keeps all of them
+  constexpr std::size_t large = 0x100000;
+  constexpr std::size_t small = 0x200;
+  auto passed = true;
+  for (auto capacity : {large, small}) {
+    auto nes = busy_console();
+    if (!nes) {
+      std::printf("rewind_restores_snapshots: unable to load the ROM\n");
+      return false;
+    }
+
+    rewind_buffer rewind{capacity};
+    std::vector<std::unique_ptr<save_state>> pushed;
+    for (auto frame = 0; frame < frames; ++frame) {
+      static_cast<void>(nes->run_frame());
+      rewind.push(*nes);
+      pushed.push_back(std::make_unique<save_state>());
+      nes->save(*pushed.back());
+    }
+    auto kept_all = rewind.size() == frames - 1;
+    if (rewind.size() == 0 || kept_all != (capacity == large)) {
+      std::printf(
+          "rewind_restores_snapshots: %zu steps back with %zu bytes for "
+          "deltas\n",
+          rewind.size(), capacity);
+      passed = false;
+    }
+
+    auto actual = std::make_unique<save_state>();
+    pushed.pop_back();
+    while (rewind.rewind(*nes)) {
+      nes->save(*actual);
+      if (pushed.empty() || !same_state(*actual, *pushed.back())) {
+        std::printf(
+            "rewind_restores_snapshots: wrong state %zu frames from the "
+            "start, with %zu bytes for deltas\n",
+            pushed.size(), capacity);
+        passed = false;
+        break;
+      }
+      pushed.pop_back();
+    }
+  }
+  return passed;
+}
+
+// The DMC announces its IRQ for the cycle it actually comes at, not earlier,
+// so the scheduler does not crawl towards it in tiny batches
+bool dmc_irq_on_time() {
+  ram_controller memory;
+  apu sound{memory};
+  sound.reset(0);
+  // Only the DMC may raise an IRQ, at the slowest rate after 17 bytes
+  sound.write_register(0x4017, 0x40);
+  sound.write_register(0x4010, 0x80);
+  sound.write_register(0x4013, 0x01);
+  sound.write_register(0x4015, 0x10);
+  auto expected = sound.cycle_of_next_irq();
+  // Catching up in steps to the cycle before must neither raise it nor move
+  // it
+  auto early = [&](std::uint64_t cycle) {
+    sound.run_until(cycle);
+    if (!sound.irq() && sound.cycle_of_next_irq() == expected) {
+      return false;
+    }
+    std::printf("dmc_irq_on_time: expected the IRQ at %llu, at %llu it %s\n",
+                static_cast<unsigned long long>(expected),
+                static_cast<unsigned long long>(cycle),
+                sound.irq() ? "came" : "moved");
+    return true;
+  };
+  for (std::uint64_t cycle = 1000; cycle < expected - 1; cycle += 1000) {
+    if (early(cycle)) {
+      return false;
+    }
+  }
+  if (early(expected - 1)) {
+    return false;
+  }
+  sound.run_until(expected);
+  if (!sound.irq()) {
+    std::printf("dmc_irq_on_time: no IRQ at %llu\n",
+                static_cast<unsigned long long>(expected));
+    return false;
+  }
+  return true;
+}
+
+// CNROM switches all 8 KiB of CHR, not just the lower pattern table
+bool cnrom_switches_both_pattern_tables() {
+  test_rom rom;
+  rom.mapper = 3;
+  rom.chr.resize(2 * 0x2000);
+  // Marks the start of both pattern tables in both banks
+  rom.chr[0x0000] = 0x00;
+  rom.chr[0x1000] = 0x01;
+  rom.chr[0x2000] = 0x10;
+  rom.chr[0x3000] = 0x11;
+  rom.put(0xC000, {0x4C, 0x00, 0xC0});  // JMP $C000
+  rom.set_vectors(0xC000, 0xC000, 0xC000);
+  auto cart = rom.load();
+  if (!cart) {
+    std::printf(
+        "cnrom_switches_both_pattern_tables: unable to load the ROM\n");
+    return false;
+  }
+
+  auto nes = std::make_unique<scheduler<>>(std::move(*cart));
+  nes->reset();
+  nes->memory().write8(0x8000, 1);
+  const auto& vram = nes->ppu().vram();
+  auto lower = vram.read8(0x0000);
+  auto upper = vram.read8(0x1000);
+  if (lower != 0x10 || upper != 0x11) {
+    std::printf(
+        "cnrom_switches_both_pattern_tables: read $%02X/$%02X from "
+        "$0000/$1000 in bank 1, expected $10/$11\n",
+        lower, upper);
+    return false;
+  }
+  return true;
+}
+
+// NES 2.0 exponent sizes that overflow when added up must not make a tiny
+// file look large enough, and CHR-ROM has to come in whole 1 KiB banks
+bool rejects_bad_nes2_sizes() {
+  struct {
+    std::uint8_t prg;
+    std::uint8_t chr;
+    std::uint8_t size_msb;
+    rom_error expected;
+  } cases[] = {
+      {0xFC, 0xFC, 0xFF, rom_error::truncated},
+      {0x01, 0x00, 0xF0, rom_error::unsupported_chr_rom_size},
+      {0x01, 0x0B, 0xF0, rom_error::unsupported_chr_rom_size},
+  };
+  auto passed = true;
+  for (const auto& test : cases) {
+    std::vector<std::uint8_t> image{'N', 'E', 'S', 0x1A, test.prg, test.chr,
+                                    0x00, 0x08, 0x00, test.size_msb};
+    image.resize(16 + 0x4000 + 0x2000);
+    rom_header header{};
+    auto error = parse_rom_header(byte_span{image.data(), image.size()},
+                                  header);
+    if (error != test.expected) {
+      std::printf("rejects_bad_nes2_sizes: $%02X/$%02X gave \"%s\"\n",
+                  test.prg, test.chr, rom_error_message(error));
+      passed = false;
+    }
+  }
+  return passed;
+}
+
+// Every handler has to agree with opcode_infos on how long its instruction
+// is, and on how many cycles it takes without crossing a page or branching
+bool handlers_match_opcode_infos() {
+  // The operands $10 $02 make absolute addressing read $0210, zero page $10,
+  // and the indirect modes go through $10/$11 to $0300. With X and Y at 1
+  // none of that crosses a page.
+  constexpr std::uint16_t start = 0x0200;
+  auto passed = true;
+  for (unsigned opcode = 0; opcode < 0x100; ++opcode) {
+    const auto& info = opcode_infos[opcode];
+    auto ends_at = start + info.length;
+    // Branches are not taken with one of these, nothing else cares
+    for (auto status : {std::uint8_t{0x00}, std::uint8_t{0xFF}}) {
+      ram_controller memory;
+      memory.write8(start, static_cast<std::uint8_t>(opcode));
+      memory.write8(start + 1, 0x10);
+      memory.write8(start + 2, 0x02);
+      memory.write8(0x0011, 0x03);
+      cpu_registers registers;
+      registers.set_status(status);
+      registers.set_x(1);
+      registers.set_y(1);
+      registers.set_pc(start + 1);
+      auto cycles = opcode::handlers[opcode](registers, memory);
+      if (info.mode == addressing_mode::relative && registers.pc() != ends_at) {
+        continue;
+      }
+
+      // Jumps, returns, BRK and JAM go somewhere else on purpose
+      auto moves_pc = opcode == 0x00 || opcode == 0x20 || opcode == 0x40 ||
+                      opcode == 0x4C || opcode == 0x60 || opcode == 0x6C ||
+                      info.mnemonic == std::string_view{"JAM"};
+      if (cycles != info.base_cycles ||
+          (!moves_pc && registers.pc() != ends_at)) {
+        std::printf(
+            "handlers_match_opcode_infos: $%02X %s took %d cycles and %d "
+            "bytes, expected %d and %d\n",
+            opcode, info.mnemonic, cycles, registers.pc() - start,
+            info.base_cycles, info.length);
+        passed = false;
+      }
+      break;
+    }
+  }
+  return passed;
+}
+
+}  // namespace
+
+int main() {
+  auto passed = true;
+  for (auto* check : {nmi_every_frame, cnrom_switches_both_pattern_tables,
+                      rejects_bad_nes2_sizes, handlers_match_opcode_infos,
+                      save_state_round_trip, rewind_restores_snapshots,
+                      dmc_irq_on_time}) {
+    passed = check() && passed;
+  }
+  std::printf(passed ? "All checks passed\n" : "Some checks failed\n");
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+#ifndef NES_REWIND_BUFFER_H
+#define NES_REWIND_BUFFER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "delta_codec.h"
+#include "save_state.h"
+
+// Keeps a history of console states in a fixed amount of memory, for
+// stepping back in time one snapshot at a time.
+//
+// Only the newest snapshot is kept in full. Every older one is stored as the
+// delta that turns its successor back into it (see delta_codec.h), so the
+// oldest deltas can simply be dropped when memory runs out. A delta only
+// covers the 256 byte chunks of save_state that may have changed: RAM and
+// VRAM pages nothing wrote to since the previous snapshot are skipped
+// without even being compared.
+//
+// A record is the number of changed chunks followed by the index and
+// encoding of each of them.
+class rewind_buffer {
+ public:
+  // capacity is the number of bytes to use for deltas
+  explicit rewind_buffer(std::size_t capacity)
+      : m_storage(capacity),
+        m_current(std::make_unique<save_state>()),
+        m_next(std::make_unique<save_state>()) {}
+
+  // Number of times rewind() can step back
+  [[nodiscard]] std::size_t size() const noexcept { return m_records.size(); }
+
+  [[nodiscard]] std::size_t bytes_used() const noexcept {
+    std::size_t used = 0;
+    for (const auto& record : m_records) {
+      used += record.size;
+    }
+    return used;
+  }
+
+  void clear() noexcept {
+    m_records.clear();
+    m_has_current = false;
+  }
+
+  // Takes a snapshot of console (a scheduler)
+  template <typename Console>
+  void push(Console& console) {
+    console.save(*m_next);
+    auto ram_pages = console.memory().take_dirty_pages();
+    auto vram_pages = console.ppu().take_dirty_vram();
+    if (!m_has_current) {
+      std::swap(m_current, m_next);
+      m_has_current = true;
+      return;
+    }
+
+    m_delta.assign(1, 0);
+    for (std::size_t chunk = 0; chunk < chunk_count; ++chunk) {
+      if (!may_have_changed(chunk, ram_pages, vram_pages)) {
+        continue;
+      }
+      auto offset = chunk * chunk_size;
+      auto size = std::min(chunk_size, sizeof(save_state) - offset);
+      const auto* from = bytes(*m_next) + offset;
+      const auto* to = bytes(*m_current) + offset;
+      if (std::memcmp(from, to, size) == 0) {
+        continue;
+      }
+      ++m_delta[0];
+      m_delta.push_back(static_cast<std::uint8_t>(chunk));
+      encode_delta(from, to, size, m_delta);
+    }
+
+    store(m_delta.data(), m_delta.size());
+    std::swap(m_current, m_next);
+  }
+
+  // Restores console to the snapshot before the newest one, which then
+  // becomes the newest. Returns false if there is no such snapshot.
+  template <typename Console>
+  bool rewind(Console& console) {
+    if (m_records.empty()) {
+      return false;
+    }
+
+    auto record = m_records.back();
+    m_records.pop_back();
+    const auto* encoded = m_storage.data() + record.offset;
+    for (auto count = *encoded++; count > 0; --count) {
+      auto offset = std::size_t{*encoded++} * chunk_size;
+      auto size = std::min(chunk_size, sizeof(save_state) - offset);
+      encoded = apply_delta(encoded, bytes(*m_current) + offset, size);
+    }
+
+    static_cast<void>(console.load(*m_current));
+    // The console now matches m_current exactly
+    static_cast<void>(console.memory().take_dirty_pages());
+    static_cast<void>(console.ppu().take_dirty_vram());
+    return true;
+  }
+
+ private:
+  static constexpr std::size_t chunk_size = 0x100;
+  static constexpr std::size_t chunk_count =
+      (sizeof(save_state) + chunk_size - 1) / chunk_size;
+  static_assert(chunk_count < 0x100,
+                "chunk indices and counts are stored in a byte");
+
+  struct stored_delta {
+    std::size_t offset;
+    std::size_t size;
+  };
+
+  [[nodiscard]] static std::uint8_t* bytes(save_state& state) noexcept {
+    return reinterpret_cast<std::uint8_t*>(&state);
+  }
+
+  // True if chunk overlaps anything but the clean pages of the tracked
+  // memory arrays
+  [[nodiscard]] static bool may_have_changed(
+      std::size_t chunk,
+      std::uint64_t ram_pages,
+      std::uint64_t vram_pages) noexcept {
+    constexpr std::size_t ram = offsetof(save_state, memory.ram);
+    constexpr std::size_t prg_ram = offsetof(save_state, memory.prg_ram);
+    constexpr std::size_t vram = offsetof(save_state, ppu.vram);
+    constexpr std::size_t ram_size = sizeof(memory_state::ram);
+    constexpr std::size_t prg_ram_size = sizeof(memory_state::prg_ram);
+    constexpr std::size_t vram_size = sizeof(vram_state);
+
+    auto first = chunk * chunk_size;
+    auto last = first + chunk_size - 1;
+    // Bytes of the chunk that are in a tracked array, and for which it is
+    // known whether they changed
+    std::size_t tracked = 0;
+    auto check = [&](std::size_t start, std::size_t size,
+                     std::uint64_t pages) {
+      if (last < start || first >= start + size) {
+        return false;
+      }
+      auto from = first > start ? first - start : 0;
+      auto to = std::min(last - start, size - 1);
+      tracked += to - from + 1;
+      for (auto page = from / chunk_size; page <= to / chunk_size; ++page) {
+        if (((pages >> page) & 1U) != 0) {
+          return true;
+        }
+      }
+      return false;
+    };
+
+    if (check(ram, ram_size, ram_pages) ||
+        check(prg_ram, prg_ram_size,
+              ram_pages >> ram_controller::dirty_prg_ram_shift) ||
+        check(vram, vram_size, vram_pages)) {
+      return true;
+    }
+    return tracked < chunk_size;
+  }
+
+  // Appends a record, dropping the oldest ones to make room
+  void store(const std::uint8_t* data, std::size_t size) {
+    if (size > m_storage.size()) {
+      // Can never fit, and without it there is no way back past this point
+      m_records.clear();
+      return;
+    }
+
+    std::size_t position = 0;
+    if (!m_records.empty()) {
+      position = m_records.back().offset + m_records.back().size;
+    }
+    if (position + size > m_storage.size()) {
+      // Whatever is stored after the newest record is older than anything
+      // at the start of the storage
+      while (!m_records.empty() && m_records.front().offset >= position) {
+        m_records.pop_front();
+      }
+      position = 0;
+    }
+    while (!m_records.empty() && m_records.front().offset >= position &&
+           m_records.front().offset < position + size) {
+      m_records.pop_front();
+    }
+
+    std::memcpy(m_storage.data() + position, data, size);
+    m_records.push_back(stored_delta{position, size});
+  }
+
+  std::vector<std::uint8_t> m_storage;
+  std::deque<stored_delta> m_records;
+  // The newest snapshot, and scratch space for the one being taken
+  std::unique_ptr<save_state> m_current;
+  std::unique_ptr<save_state> m_next;
+  bool m_has_current{false};
+  std::vector<std::uint8_t> m_delta;
+};
+
+#endif  // NES_REWIND_BUFFER_H
@@ -0,0 +1,194 @@
+#ifndef NES_ROM_HEADER_H
+#define NES_ROM_HEADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include "common.h"
+
+enum class rom_format : std::uint8_t { ines, nes2 };
+
+// The single screen modes can only be selected by mappers
+enum class mirroring : std::uint8_t {
+  horizontal,
+  vertical,
+  four_screen,
+  single_screen_lower,
+  single_screen_upper
+};
+
+enum class rom_error {
+  none,
+  cannot_open,
+  too_small,
+  bad_magic,
+  no_prg_rom,
+  unsupported_prg_rom_size,
+  unsupported_chr_rom_size,
+  truncated,
+  unsupported_mapper,
+  out_of_memory
+};
+
+[[nodiscard]] constexpr const char* rom_error_message(rom_error error) noexcept {
+  switch (error) {
+    case rom_error::none:
+      return "no error";
+    case rom_error::cannot_open:
+      return "the file could not be opened";
+    case rom_error::too_small:
+      return "the file is too small to contain an iNES header";
+    case rom_error::bad_magic:
+      return "NES header not found";
+    case rom_error::no_prg_rom:
+      return "the header declares no PRG-ROM";
+    case rom_error::unsupported_prg_rom_size:
+      return "PRG-ROM is not a multiple of 16 KiB";
+    case rom_error::unsupported_chr_rom_size:
+      return "CHR-ROM is not a multiple of 1 KiB or too small for the mapper";
+    case rom_error::truncated:
+      return "the file is smaller than the sizes declared in the header";
+    case rom_error::unsupported_mapper:
+      return "the mapper used by the cartridge is not supported";
+    case rom_error::out_of_memory:
+      return "there is not enough memory to load the cartridge";
+  }
+  return "unknown error";
+}
+
+struct rom_header {
+  static constexpr std::size_t size = 16;
+  static constexpr std::size_t trainer_size = 512;
+
+  rom_format format;
+  std::uint16_t mapper;
+  std::uint8_t submapper;
+  ::mirroring mirroring;
+  bool has_battery;
+  bool has_trainer;
+  std::size_t prg_rom_size;
+  std::size_t chr_rom_size;
+  // Volatile and battery backed RAM on the cartridge, 0 if there is none
+  std::size_t prg_ram_size;
+  std::size_t prg_nvram_size;
+  // CHR-RAM is only used when chr_rom_size is 0
+  std::size_t chr_ram_size;
+  std::size_t chr_nvram_size;
+
+  // Size of the whole image as declared by the header. Only valid once
+  // parse_rom_header() accepted it, before that the sum can overflow.
+  [[nodiscard]] constexpr std::size_t image_size() const noexcept {
+    return size + (has_trainer ? trainer_size : 0) + prg_rom_size +
+           chr_rom_size;
+  }
+};
+
+// NES 2.0 ROM sizes are either a 12 bit count of units, or an
+// exponent-multiplier pair when the upper nibble is $F. Sizes that do not
+// fit in a std::size_t come out as its maximum, which no file can hold.
+[[nodiscard]] constexpr std::size_t nes2_rom_size(std::uint8_t lsb,
+                                                  std::uint8_t msb_nibble,
+                                                  std::size_t unit) noexcept {
+  if (msb_nibble == 0x0F) {
+    constexpr auto max_size = std::numeric_limits<std::size_t>::max();
+    auto exponent = static_cast<unsigned>(lsb >> 2U);
+    auto multiplier = static_cast<std::size_t>((lsb & 0x03U) * 2U + 1U);
+    if (exponent >= std::numeric_limits<std::size_t>::digits ||
+        (std::size_t{1} << exponent) > max_size / multiplier) {
+      return max_size;
+    }
+    return (std::size_t{1} << exponent) * multiplier;
+  }
+  return (static_cast<std::size_t>(msb_nibble) << 8U | lsb) * unit;
+}
+
+// NES 2.0 RAM sizes are shift counts, 64 << shift bytes
+[[nodiscard]] constexpr std::size_t nes2_ram_size(unsigned shift) noexcept {
+  return shift == 0 ? 0 : std::size_t{64} << shift;
+}
+
+// Parses and validates the 16 byte header at the start of image. Also
+// checks that image is large enough to hold everything the header declares.
+[[nodiscard]] constexpr rom_error parse_rom_header(byte_span image,
+                                                   rom_header& header) noexcept {
+  if (image.size() < rom_header::size) {
+    return rom_error::too_small;
+  }
+  if (image[0] != 'N' || image[1] != 'E' || image[2] != 'S' ||
+      image[3] != 0x1A) {
+    return rom_error::bad_magic;
+  }
+
+  auto flags6 = image[6];
+  auto flags7 = image[7];
+
+  header = rom_header{};
+  header.has_battery = (flags6 & 0b00000010U) != 0;
+  header.has_trainer = (flags6 & 0b00000100U) != 0;
+  if ((flags6 & 0b00001000U) != 0) {
+    header.mirroring = mirroring::four_screen;
+  } else if ((flags6 & 0b00000001U) != 0) {
+    header.mirroring = mirroring::vertical;
+  } else {
+    header.mirroring = mirroring::horizontal;
+  }
+
+  auto mapper = static_cast<unsigned>(flags6 >> 4U);
+  if ((flags7 & 0b00001100U) == 0b00001000U) {
+    header.format = rom_format::nes2;
+    mapper |= flags7 & 0xF0U;
+    mapper |= (image[8] & 0x0FU) << 8U;
+    header.submapper = static_cast<std::uint8_t>(image[8] >> 4U);
+    header.prg_rom_size = nes2_rom_size(
+        image[4], static_cast<std::uint8_t>(image[9] & 0x0FU), 0x4000);
+    header.chr_rom_size = nes2_rom_size(
+        image[5], static_cast<std::uint8_t>(image[9] >> 4U), 0x2000);
+    header.prg_ram_size = nes2_ram_size(image[10] & 0x0FU);
+    header.prg_nvram_size = nes2_ram_size(image[10] >> 4U);
+    header.chr_ram_size = nes2_ram_size(image[11] & 0x0FU);
+    header.chr_nvram_size = nes2_ram_size(image[11] >> 4U);
+  } else {
+    header.format = rom_format::ines;
+    // Old dumping tools wrote garbage like "DiskDude!" into bytes 7-15. Only
+    // trust the upper mapper nibble if the padding is clean.
+    if (image[12] == 0 && image[13] == 0 && image[14] == 0 &&
+        image[15] == 0) {
+      mapper |= flags7 & 0xF0U;
+    }
+    header.prg_rom_size = std::size_t{image[4]} * 0x4000;
+    header.chr_rom_size = std::size_t{image[5]} * 0x2000;
+    // iNES can not express "no PRG-RAM", 0 means 8 KiB for compatibility
+    auto prg_ram_size = std::size_t{image[8] == 0 ? 1U : image[8]} * 0x2000;
+    if (header.has_battery) {
+      header.prg_nvram_size = prg_ram_size;
+    } else {
+      header.prg_ram_size = prg_ram_size;
+    }
+    header.chr_ram_size = header.chr_rom_size == 0 ? 0x2000 : 0;
+  }
+  header.mapper = static_cast<std::uint16_t>(mapper);
+
+  if (header.prg_rom_size == 0) {
+    return rom_error::no_prg_rom;
+  }
+  if (header.prg_rom_size % 0x4000 != 0) {
+    return rom_error::unsupported_prg_rom_size;
+  }
+  // CHR banks are mapped 1 KiB at a time
+  if (header.chr_rom_size % 0x400 != 0) {
+    return rom_error::unsupported_chr_rom_size;
+  }
+  // One part at a time, as NES 2.0 sizes can overflow when added up
+  auto remaining = image.size() - rom_header::size;
+  for (auto part : {header.has_trainer ? rom_header::trainer_size : 0,
+                    header.prg_rom_size, header.chr_rom_size}) {
+    if (remaining < part) {
+      return rom_error::truncated;
+    }
+    remaining -= part;
+  }
+  return rom_error::none;
+}
+
+#endif  // NES_ROM_HEADER_H
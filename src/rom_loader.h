@@ -5,48 +5,60 @@
 #ifndef NES_ROM_LOADER_H
 #define NES_ROM_LOADER_H
 
-#include <istream>
+#include <memory>
+#include <new>
+#include <optional>
 #include "cartridge.h"
-#include <string>
-#include <vector>
+#include "mapped_file.h"
+#include "mapper.h"
+#include "rom_header.h"
 
-[[nodiscard]] cartridge load_rom(std::istream& stream) noexcept {
-  char header[16];
-  stream.read(header, 16);
-
-  std::string constant{header,3};
-  if(constant != "NES") {
-    std::cerr << "NES header not found!\n";
-    abort();
+// Builds a cartridge from an image that is already in memory
+[[nodiscard]] std::optional<cartridge> load_rom(
+    std::shared_ptr<const mapped_file> image,
+    rom_error& error) noexcept {
+  rom_header header{};
+  error = parse_rom_header(image->bytes(), header);
+  if (error != rom_error::none) {
+    return std::nullopt;
   }
-
-  int prg_rom_bank_count = header[4];
-  int chr_rom_size = header[5] * 0x2000;
-  auto flags6 = static_cast<std::uint8_t>(header[6]);
-
-  const auto has_traniner_mask = 0b00000100;
-
-  if((flags6 & has_traniner_mask) == has_traniner_mask) {
-    // There are 512 bytes of trainer data before the prg rom, so we skip
-    // past is for now.
-    stream.seekg(512, std::ios_base::cur);
+  if (!is_supported_mapper(header.mapper)) {
+    error = rom_error::unsupported_mapper;
+    return std::nullopt;
+  }
+  if (header.chr_rom_size != 0 &&
+      header.chr_rom_size < min_chr_rom_size(header.mapper)) {
+    error = rom_error::unsupported_chr_rom_size;
+    return std::nullopt;
   }
 
-  auto g = stream.tellg();
-
-  std::vector<prg_rom_bank> prg_rom_banks;
-  for(auto i = 0; i < prg_rom_bank_count; ++i) {
-    std::array<char, 0x4000> buffer;
-    std::array<std::uint8_t, 0x4000> rom_bank;
+  // The PRG-ROM bank list is the only allocation
+  try {
+    return cartridge{std::move(image), header};
+  } catch (const std::bad_alloc&) {
+    error = rom_error::out_of_memory;
+    return std::nullopt;
+  }
+}
 
-    stream.read(buffer.data(), buffer.size());
-    std::memcpy(rom_bank.data(), buffer.data(), rom_bank.size());
-    prg_rom_banks.emplace_back(rom_bank);
-    // I could have done away with the buffer vector and just reinterpret_cast'ed rom_bank in the stream.read() call,
-    // but i am trying to avoid using reinterpret_cast here (after listening to Jason Turners advice)
+// Maps the iNES / NES 2.0 file at path into memory and builds a cartridge
+// from it, without copying any of the ROM data. On failure the reason is
+// stored in error.
+[[nodiscard]] std::optional<cartridge> load_rom(const char* path,
+                                                rom_error& error) noexcept {
+  std::shared_ptr<const mapped_file> image;
+  try {
+    image = mapped_file::open(path);
+  } catch (const std::bad_alloc&) {
+    error = rom_error::out_of_memory;
+    return std::nullopt;
+  }
+  if (!image) {
+    error = rom_error::cannot_open;
+    return std::nullopt;
   }
 
-  return cartridge{prg_rom_banks};
+  return load_rom(std::move(image), error);
 }
 
 #endif  // NES_ROM_LOADER_H
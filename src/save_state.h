@@ -0,0 +1,58 @@
+#ifndef NES_SAVE_STATE_H
+#define NES_SAVE_STATE_H
+
+#include <cstdint>
+#include <type_traits>
+#include "apu.h"
+#include "controller.h"
+#include "cpu.h"
+#include "mapper.h"
+#include "ppu.h"
+#include "ram_controller.h"
+
+// Scheduler bookkeeping that has to survive a restore
+struct scheduler_state {
+  controller controllers[2];
+  std::uint64_t ppu_synced_cycle;
+};
+
+struct save_state_header {
+  char magic[4];
+  std::uint16_t version;
+  std::uint16_t reserved;
+  std::uint32_t size;
+};
+
+// The complete state of a console, as plain bytes. Taking and restoring one
+// is a few memcpys, and a save_state can be written to and read from a file
+// as is.
+//
+// Only valid for the ROM it was taken from, and only between builds with the
+// same save_state_version. Bump the version whenever the layout of anything
+// in here changes.
+struct save_state {
+  save_state_header header;
+  cpu_state cpu;
+  memory_state memory;
+  ppu_state ppu;
+  mapper_state mapper;
+  apu_state apu;
+  scheduler_state scheduler;
+};
+
+static_assert(std::is_trivially_copyable_v<save_state>);
+
+constexpr std::uint16_t save_state_version = 7;
+
+constexpr save_state_header current_save_state_header{
+    {'N', 'E', 'S', 'S'}, save_state_version, 0, sizeof(save_state)};
+
+[[nodiscard]] constexpr bool is_valid_save_state_header(
+    const save_state_header& header) noexcept {
+  return header.magic[0] == 'N' && header.magic[1] == 'E' &&
+         header.magic[2] == 'S' && header.magic[3] == 'S' &&
+         header.version == current_save_state_header.version &&
+         header.size == current_save_state_header.size;
+}
+
+#endif  // NES_SAVE_STATE_H
@@ -0,0 +1,320 @@
+#ifndef NES_SCHEDULER_H
+#define NES_SCHEDULER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include "apu.h"
+#include "cartridge.h"
+#include "controller.h"
+#include "cpu.h"
+#include "hash.h"
+#include "mapper.h"
+#include "ppu.h"
+#include "profile.h"
+#include "ram_controller.h"
+#include "recompiled.h"
+#include "save_state.h"
+#include "trace.h"
+
+// Owns a complete console and decides who runs when.
+//
+// Instead of stepping the PPU three dots after every CPU instruction, the CPU
+// runs uninterrupted up to the next point where the PPU can affect it (the
+// start of vblank, which may raise an NMI), and the PPU then catches up with
+// all of those cycles in one go. The only other time the PPU is brought up to
+// date is when the CPU touches one of its registers, so that the CPU always
+// observes the PPU state for the cycle it is on.
+//
+// Synchronisation happens at instruction granularity: a register access is
+// seen as happening at the start of the instruction doing it.
+//
+// Mapper IRQs work like vblank: the mapper says how many scanlines away its
+// IRQ is, and the CPU runs no further than that before the PPU catches up.
+//
+// The APU is caught up the same way, at the end of every batch and whenever
+// the CPU touches one of its registers. It tells how far away its next IRQ
+// (frame counter or DMC) can be at the earliest.
+//
+// Interrupt lines are sampled at the end of every batch and the CPU polls
+// them between instructions. A batch in which something holds the IRQ line
+// ends as soon as the CPU would take it.
+//
+// OAM DMA ($4014) copies the whole page into OAM at once and charges the CPU
+// the 513 or 514 cycles it is halted for.
+//
+// Trace and Profile are passed on to cpu2a03.
+template <typename Trace = null_trace, typename Profile = null_profile>
+class scheduler : public io_device {
+ public:
+  static constexpr int ppu_cycles_per_cpu_cycle = 3;
+
+  template <typename... TraceArgs>
+  explicit scheduler(cartridge cart, TraceArgs&&... trace_args)
+      : m_cartridge(std::move(cart)),
+        m_apu(m_memory),
+        m_cpu(m_memory, std::forward<TraceArgs>(trace_args)...) {
+    m_ppu.vram().load_chr(m_cartridge.chr_rom());
+    m_mapper = make_mapper(m_cartridge, m_memory, m_ppu);
+    if (!m_mapper) {
+      // load_rom() refuses these, but NROM is better than nothing
+      m_mapper = std::make_unique<nrom>(m_cartridge, m_memory, m_ppu);
+    }
+    m_mapper->reset();
+
+    m_ppu.attach(m_mapper.get());
+    m_memory.attach(page_type::ppu_registers, this);
+    m_memory.attach(page_type::apu_io_registers, this);
+    m_memory.attach(page_type::cartridge, this);
+  }
+
+  // The memory map holds on to this
+  scheduler(const scheduler&) = delete;
+  scheduler& operator=(const scheduler&) = delete;
+
+  ~scheduler() override {
+    m_memory.attach(page_type::ppu_registers, nullptr);
+    m_memory.attach(page_type::apu_io_registers, nullptr);
+    m_memory.attach(page_type::cartridge, nullptr);
+  }
+
+  void reset() noexcept {
+    m_mapper->reset();
+    m_cpu.reset();
+    m_apu.reset(m_cpu.cycles());
+    m_ppu_synced_cycle = m_cpu.cycles();
+  }
+
+  // The reset button. The CPU goes through its reset sequence before the
+  // next instruction, memory and mapper registers keep their contents.
+  void soft_reset() noexcept {
+    m_cpu.signal_reset();
+    // Writing $00 to $4015 silences every channel, like a reset does
+    sync_apu();
+    m_apu.write_register(0x4015, 0);
+  }
+
+  // Runs the PRG-ROM code that program has recompiled blocks for through
+  // those. Returns false, and keeps interpreting everything, unless the
+  // cartridge is NROM (whose PRG-ROM never moves) and program was recompiled
+  // from its PRG-ROM.
+  bool use_recompiled(const recompiled_program& program) noexcept {
+    if (m_cartridge.header().mapper != 0 ||
+        program.prg_rom_hash != fnv1a_64(m_cartridge.prg_rom_data())) {
+      return false;
+    }
+    m_cpu.use_recompiled(program.blocks);
+    return true;
+  }
+
+  // Runs at least the given number of CPU cycles. The last instruction may
+  // take the total slightly past it.
+  void run_cycles(std::uint64_t cycles) noexcept {
+    run_until(m_cpu.cycles() + cycles);
+  }
+
+  // Runs until the PPU enters the next vblank, or until the CPU has reached
+  // cycle_limit. Returns true if vblank was reached.
+  bool run_frame(std::uint64_t cycle_limit = UINT64_MAX) noexcept {
+    sync_ppu();
+    auto vblank = cycle_of_next_vblank();
+    run_until(vblank < cycle_limit ? vblank : cycle_limit);
+    return m_cpu.cycles() >= vblank;
+  }
+
+  // Sets the buttons (a mask of button values) held on controller 1 or 2
+  constexpr void set_buttons(std::size_t port, std::uint8_t buttons) noexcept {
+    m_controllers[port].set_buttons(buttons);
+  }
+
+  // Must be called between two run_*() calls
+  void save(save_state& state) const noexcept {
+    state.header = current_save_state_header;
+    m_cpu.save(state.cpu);
+    m_memory.save(state.memory);
+    m_ppu.save(state.ppu);
+    m_mapper->save(state.mapper);
+    m_apu.save(state.apu);
+    state.scheduler.controllers[0] = m_controllers[0];
+    state.scheduler.controllers[1] = m_controllers[1];
+    state.scheduler.ppu_synced_cycle = m_ppu_synced_cycle;
+  }
+
+  // Returns false, leaving the console untouched, if state was taken by an
+  // incompatible build
+  bool load(const save_state& state) noexcept {
+    if (!is_valid_save_state_header(state.header)) {
+      return false;
+    }
+    m_cpu.load(state.cpu);
+    m_memory.load(state.memory);
+    m_ppu.load(state.ppu);
+    m_mapper->load(state.mapper);
+    m_apu.load(state.apu);
+    m_controllers[0] = state.scheduler.controllers[0];
+    m_controllers[1] = state.scheduler.controllers[1];
+    m_ppu_synced_cycle = state.scheduler.ppu_synced_cycle;
+    return true;
+  }
+
+  [[nodiscard]] std::uint8_t read_io(std::uint16_t address) override {
+    if (address >= 0x8000) {
+      // PRG-ROM is always mapped, nothing to read from the mapper
+      return 0;
+    }
+    if (address >= 0x4000) {
+      if (address == 0x4016 || address == 0x4017) {
+        // The upper bits are open bus, usually the $40 of the address
+        return static_cast<std::uint8_t>(
+            0x40U | m_controllers[address - 0x4016U].read());
+      }
+      if (address == 0x4015) {
+        sync_apu();
+        return m_apu.read_status();
+      }
+      // Everything else is write only
+      return 0;
+    }
+
+    sync_ppu();
+    return m_ppu.read_register(address);
+  }
+
+  void write_io(std::uint16_t address, std::uint8_t value) override {
+    if (address >= 0x8000) {
+      // The scanline counter has to be up to date before it is changed, and
+      // the next IRQ may have moved afterwards
+      sync_ppu();
+      // The DMC may still have to fetch from the current banks
+      sync_apu();
+      m_mapper->write(address, value);
+      m_batch_end = m_cpu.cycles();
+      return;
+    }
+    if (address >= 0x4000) {
+      if (address == 0x4016) {
+        m_controllers[0].write_strobe(value);
+        m_controllers[1].write_strobe(value);
+      } else if (address == 0x4014) {
+        oam_dma(value);
+      } else if (address < 0x4018) {
+        sync_apu();
+        m_apu.write_register(address, value);
+        // The next APU IRQ may have moved
+        m_batch_end = m_cpu.cycles();
+      }
+      return;
+    }
+
+    sync_ppu();
+    m_ppu.write_register(address, value);
+    if (m_ppu.nmi_pending() || m_mapper->scanlines_until_irq() > 0) {
+      // Deliver the NMI after this instruction, or find out whether turning
+      // rendering on or off moved the next IRQ
+      m_batch_end = m_cpu.cycles();
+    }
+  }
+
+  [[nodiscard]] constexpr auto& cpu() noexcept { return m_cpu; }
+  [[nodiscard]] constexpr auto& ppu() noexcept { return m_ppu; }
+  [[nodiscard]] constexpr auto& apu() noexcept { return m_apu; }
+  [[nodiscard]] constexpr auto& memory() noexcept { return m_memory; }
+  [[nodiscard]] constexpr const auto& cart() const noexcept {
+    return m_cartridge;
+  }
+
+ private:
+  void run_until(std::uint64_t target) noexcept {
+    while (m_cpu.cycles() < target) {
+      // Also takes a reset signalled since the last batch
+      static_cast<void>(m_cpu.poll_interrupts());
+      m_batch_end = std::min({cycle_of_next_vblank(), cycle_of_next_irq(),
+                              m_apu.cycle_of_next_irq(), target});
+
+      if (m_cpu.irq_line()) {
+        // The CPU ignores it for now, stop as soon as it stops doing that
+        while (m_cpu.cycles() < m_batch_end && !m_cpu.interrupt_pending()) {
+          static_cast<void>(m_cpu.process_instruction());
+        }
+      } else {
+        // Register writes pull m_batch_end in while this runs
+        m_cpu.run(m_batch_end);
+      }
+
+      sync_ppu();
+      sync_apu();
+      if (m_ppu.take_nmi()) {
+        m_cpu.signal_nmi();
+      }
+      m_cpu.set_irq_line(irq_source::mapper, m_mapper->irq());
+      m_cpu.set_irq_line(irq_source::apu, m_apu.irq());
+      static_cast<void>(m_cpu.poll_interrupts());
+    }
+  }
+
+  // Copies page * $100 to OAM. The CPU is halted for the 512 cycles of the
+  // copy, plus one to wait for the write cycle to end and one more when it
+  // started on an odd cycle.
+  void oam_dma(std::uint8_t page) noexcept {
+    sync_ppu();
+    const auto* data = m_memory.page_data(page);
+    std::uint8_t buffer[0x100];
+    if (data == nullptr) {
+      // Registers or open bus, every read counts
+      for (unsigned i = 0; i < sizeof(buffer); ++i) {
+        buffer[i] = m_memory.read8(static_cast<std::uint16_t>(page << 8U | i));
+      }
+      data = buffer;
+    }
+    m_ppu.write_oam_dma(data);
+    m_cpu.stall(513 + static_cast<int>(m_cpu.cycles() & 1U));
+    // The stall may have run past the end of the batch
+    m_batch_end = m_cpu.cycles();
+  }
+
+  // First CPU cycle at which the mapper will have raised its next IRQ, or
+  // UINT64_MAX if it will not raise one
+  [[nodiscard]] std::uint64_t cycle_of_next_irq() const noexcept {
+    auto dots = m_ppu.cycles_until_scanline_clock(
+        m_mapper->scanlines_until_irq());
+    if (dots < 0) {
+      return UINT64_MAX;
+    }
+    return m_ppu_synced_cycle +
+           (static_cast<std::uint64_t>(dots) + ppu_cycles_per_cpu_cycle - 1) /
+               ppu_cycles_per_cpu_cycle;
+  }
+
+  // First CPU cycle at which the PPU will have started the next vblank
+  [[nodiscard]] constexpr std::uint64_t cycle_of_next_vblank() const noexcept {
+    auto dots = static_cast<std::uint64_t>(m_ppu.cycles_until_vblank());
+    return m_ppu_synced_cycle +
+           (dots + ppu_cycles_per_cpu_cycle - 1) / ppu_cycles_per_cpu_cycle;
+  }
+
+  // Catches the PPU up with the CPU
+  constexpr void sync_ppu() noexcept {
+    auto cycles = m_cpu.cycles() - m_ppu_synced_cycle;
+    if (cycles > 0) {
+      m_ppu.process(static_cast<int>(cycles) * ppu_cycles_per_cpu_cycle);
+      m_ppu_synced_cycle = m_cpu.cycles();
+    }
+  }
+
+  // Catches the APU up with the CPU
+  void sync_apu() noexcept { m_apu.run_until(m_cpu.cycles()); }
+
+  cartridge m_cartridge;
+  ram_controller m_memory;
+  ::ppu m_ppu;
+  ::apu m_apu;
+  cpu2a03<Trace, Profile> m_cpu;
+  std::unique_ptr<mapper> m_mapper;
+  controller m_controllers[2];
+  std::uint64_t m_ppu_synced_cycle{0};
+  std::uint64_t m_batch_end{0};
+};
+
+#endif  // NES_SCHEDULER_H
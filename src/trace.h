@@ -0,0 +1,218 @@
+#ifndef NES_TRACE_H
+#define NES_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "opcode_info.h"
+
+// CPU state captured right before an instruction executes. This is
+// everything needed to reproduce a nestest style log line, without doing any
+// formatting while the emulator is running.
+struct trace_record {
+  std::uint64_t cycle;
+  std::uint16_t pc;
+  std::uint8_t opcode;
+  std::uint8_t length;
+  std::uint8_t operands[2];
+  std::uint8_t accumulator;
+  std::uint8_t x;
+  std::uint8_t y;
+  std::uint8_t status;
+  std::uint8_t stack;
+};
+
+static_assert(std::is_trivially_copyable_v<trace_record>);
+static_assert(sizeof(trace_record) == 24);
+
+// Every trace file starts with this header, followed by trace_records until
+// the end of the file.
+struct trace_file_header {
+  char magic[4];
+  std::uint16_t version;
+  std::uint16_t record_size;
+};
+
+constexpr trace_file_header current_trace_file_header{
+    {'N', 'E', 'S', 'T'}, 1, sizeof(trace_record)};
+
+[[nodiscard]] constexpr bool is_valid_trace_file_header(
+    const trace_file_header& header) noexcept {
+  return header.magic[0] == 'N' && header.magic[1] == 'E' &&
+         header.magic[2] == 'S' && header.magic[3] == 'T' &&
+         header.version == current_trace_file_header.version &&
+         header.record_size == current_trace_file_header.record_size;
+}
+
+bool write_trace_file_header(std::FILE* file) noexcept {
+  return std::fwrite(&current_trace_file_header, sizeof(trace_file_header), 1,
+                     file) == 1;
+}
+
+// Trace policy that compiles away completely. cpu2a03 checks
+// Trace::enabled with if constexpr, so record() is never even called.
+class null_trace {
+ public:
+  static constexpr bool enabled = false;
+
+  constexpr void record(const trace_record&) noexcept {}
+};
+
+// Trace policy that collects records in memory and writes them as raw binary
+// to a file whenever the buffer fills up.
+class buffered_trace {
+ public:
+  static constexpr bool enabled = true;
+
+  explicit buffered_trace(std::FILE* file, std::size_t capacity = 0x10000)
+      : m_file(file) {
+    m_records.reserve(capacity);
+    write_trace_file_header(m_file);
+  }
+
+  buffered_trace(const buffered_trace&) = delete;
+  buffered_trace& operator=(const buffered_trace&) = delete;
+
+  ~buffered_trace() { flush(); }
+
+  void record(const trace_record& record) {
+    m_records.push_back(record);
+    if (m_records.size() == m_records.capacity()) {
+      flush();
+    }
+  }
+
+  void flush() noexcept {
+    if (!m_records.empty()) {
+      std::fwrite(m_records.data(), sizeof(trace_record), m_records.size(),
+                  m_file);
+      m_records.clear();
+    }
+  }
+
+ private:
+  std::FILE* m_file;
+  std::vector<trace_record> m_records;
+};
+
+// Trace policy that keeps the most recent records in a fixed size ring
+// buffer, meant to be left on permanently as a flight recorder. Recording is
+// a record copy plus two stores of indices.
+//
+// There is a single writer (the CPU). snapshot() may be called from any
+// other thread at any time, it never blocks the writer and only returns
+// records that were not overwritten while they were being copied. Records
+// are stored as relaxed atomic words, so reading one while it is being
+// overwritten is not a data race, just a record snapshot() throws away.
+class trace_ring {
+ public:
+  static constexpr bool enabled = true;
+
+  // capacity is rounded up to the next power of two
+  explicit trace_ring(std::size_t capacity)
+      : m_capacity(round_up_to_power_of_two(capacity)),
+        m_mask(m_capacity - 1),
+        m_slots(std::make_unique<slot[]>(m_capacity)) {}
+
+  void record(const trace_record& record) noexcept {
+    auto head = m_head.load(std::memory_order_relaxed);
+    // Announces the write before any of it can be seen, see snapshot()
+    m_started.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    store(m_slots[head & m_mask], record);
+    m_head.store(head + 1, std::memory_order_release);
+  }
+
+  [[nodiscard]] auto capacity() const noexcept { return m_capacity; }
+
+  // Total number of records written, including the ones that have since been
+  // overwritten
+  [[nodiscard]] auto total_recorded() const noexcept {
+    return m_head.load(std::memory_order_acquire);
+  }
+
+  // Replaces the contents of out with the retained records, oldest first.
+  void snapshot(std::vector<trace_record>& out) const {
+    // Every record before head is complete
+    auto head = m_head.load(std::memory_order_acquire);
+    auto count = head < m_capacity ? head : m_capacity;
+    auto first = head - count;
+
+    out.resize(count);
+    for (std::uint64_t i = 0; i < count; ++i) {
+      out[i] = load(m_slots[(first + i) & m_mask]);
+    }
+
+    // If any word we copied came from a write that started after head, that
+    // write is announced in m_started by now. Record first + capacity + n
+    // reuses the slot of out[n], so every write started since then, including
+    // one still in progress, may have torn the records at the start of out.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    auto started = m_started.load(std::memory_order_relaxed);
+    auto torn = started > first + m_capacity ? started - first - m_capacity : 0;
+    if (torn >= count) {
+      out.clear();
+    } else if (torn > 0) {
+      out.erase(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(torn));
+    }
+  }
+
+  // Writes the retained records as a trace file
+  bool dump(std::FILE* file) const {
+    std::vector<trace_record> records;
+    snapshot(records);
+    return write_trace_file_header(file) &&
+           std::fwrite(records.data(), sizeof(trace_record), records.size(),
+                       file) == records.size();
+  }
+
+ private:
+  static constexpr std::size_t slot_words =
+      sizeof(trace_record) / sizeof(std::uint64_t);
+  static_assert(sizeof(trace_record) % sizeof(std::uint64_t) == 0);
+
+  // A trace_record as words that can be read while they are written
+  struct slot {
+    std::atomic<std::uint64_t> words[slot_words];
+  };
+
+  static void store(slot& to, const trace_record& record) noexcept {
+    std::uint64_t words[slot_words];
+    std::memcpy(words, &record, sizeof(record));
+    for (std::size_t i = 0; i < slot_words; ++i) {
+      to.words[i].store(words[i], std::memory_order_relaxed);
+    }
+  }
+
+  [[nodiscard]] static trace_record load(const slot& from) noexcept {
+    std::uint64_t words[slot_words];
+    for (std::size_t i = 0; i < slot_words; ++i) {
+      words[i] = from.words[i].load(std::memory_order_relaxed);
+    }
+    trace_record record{};
+    std::memcpy(&record, words, sizeof(record));
+    return record;
+  }
+
+  [[nodiscard]] static constexpr std::uint64_t round_up_to_power_of_two(
+      std::uint64_t value) noexcept {
+    std::uint64_t result = 1;
+    while (result < value) {
+      result <<= 1U;
+    }
+    return result;
+  }
+
+  std::uint64_t m_capacity;
+  std::uint64_t m_mask;
+  std::unique_ptr<slot[]> m_slots;
+  // Number of records completely written, and number of writes started
+  std::atomic<std::uint64_t> m_head{0};
+  std::atomic<std::uint64_t> m_started{0};
+};
+
+#endif  // NES_TRACE_H
@@ -0,0 +1,56 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "trace_render.h"
+
+// Renders a binary trace file written by buffered_trace or trace_ring::dump
+// as a nestest style log on stdout.
+//
+// usage: nes_trace_render <trace file> [--last <count>]
+int main(int argc, char** argv) {
+  if (argc != 2 && !(argc == 4 && std::string{argv[2]} == "--last")) {
+    std::cerr << "usage: " << argv[0] << " <trace file> [--last <count>]\n";
+    return 1;
+  }
+
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> file{
+      std::fopen(argv[1], "rb"), &std::fclose};
+  if (!file) {
+    std::cerr << "Unable to open " << argv[1] << '\n';
+    return 1;
+  }
+
+  trace_file_header header{};
+  if (std::fread(&header, sizeof(header), 1, file.get()) != 1 ||
+      !is_valid_trace_file_header(header)) {
+    std::cerr << argv[1] << " is not a trace file of a supported version\n";
+    return 1;
+  }
+
+  if (argc == 4) {
+    auto last = std::strtoll(argv[3], nullptr, 10);
+    std::fseek(file.get(), 0, SEEK_END);
+    auto records = (std::ftell(file.get()) -
+                    static_cast<long>(sizeof(trace_file_header))) /
+                   static_cast<long>(sizeof(trace_record));
+    auto skip = records > last ? records - last : 0;
+    std::fseek(file.get(),
+               static_cast<long>(sizeof(trace_file_header)) +
+                   skip * static_cast<long>(sizeof(trace_record)),
+               SEEK_SET);
+  }
+
+  trace_record records[4096];
+  fmt::memory_buffer out;
+  std::size_t count;
+  while ((count = std::fread(records, sizeof(trace_record), std::size(records),
+                             file.get())) > 0) {
+    out.clear();
+    for (std::size_t i = 0; i < count; ++i) {
+      render_nestest(records[i], out);
+    }
+    std::fwrite(out.data(), 1, out.size(), stdout);
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef NES_TRACE_RENDER_H
+#define NES_TRACE_RENDER_H
+
+#include <iterator>
+#include "disassembler.h"
+#include "fmt/format.h"
+#include "trace.h"
+
+// Appends one nestest style log line (including the newline) for record.
+// Unofficial opcodes are marked with a * like in nestest.log, which also
+// shows the memory operands point at. Those are not in the trace.
+void render_nestest(const trace_record& record, fmt::memory_buffer& out) {
+  auto it = std::back_inserter(out);
+  it = fmt::format_to(it, "{:04X}  {:02X} ", record.pc, record.opcode);
+  switch (record.length) {
+    case 2:
+      it = fmt::format_to(it, "{:02X}    ", record.operands[0]);
+      break;
+    case 3:
+      it = fmt::format_to(it, "{:02X} {:02X} ", record.operands[0],
+                          record.operands[1]);
+      break;
+    default:
+      it = fmt::format_to(it, "      ");
+      break;
+  }
+
+  disassembled_instruction instruction{
+      record.pc, record.opcode, {record.operands[0], record.operands[1]}};
+  char text[max_instruction_text];
+  format_instruction(instruction, text);
+  it = fmt::format_to(it, "{:c}{:<32}", instruction.info().illegal ? '*' : ' ',
+                      text);
+
+  // The log counts PPU cycles, which run three times as fast as the CPU.
+  fmt::format_to(it,
+                 "A:{:02X} X:{:02X} Y:{:02X} P:{:02X} SP: {:02X} CYC: {:>3}\n",
+                 record.accumulator, record.x, record.y, record.status,
+                 record.stack, record.cycle * 3);
+}
+
+#endif  // NES_TRACE_RENDER_H
@@ -1,13 +1,229 @@
 #ifndef NES_VRAM_CONTROLLER_H
 #define NES_VRAM_CONTROLLER_H
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <vector>
+#include "common.h"
+#include "pattern_decode.h"
+#include "rom_header.h"
 
+// Contents of all memory behind the PPU address space, see save_state.h.
+// CHR-ROM is not part of it, it never changes.
+struct vram_state {
+  std::uint8_t chr_ram[0x2000];
+  // 2 KiB in the console, plus another 2 KiB on four screen cartridges
+  std::uint8_t nametables[0x1000];
+  std::uint8_t palette[0x20];
+};
+
+// The PPU address space, $0000-$3FFF.
+//
+// Like ram_controller on the CPU side, every 1 KiB page is a host pointer:
+// the eight pattern table pages point into CHR-ROM (in place, in the ROM
+// image) or CHR-RAM as the mapper banks them, and the four nametable pages
+// point into nametable memory according to the mirroring mode. Reads never
+// branch on the mirroring mode or on the kind of CHR memory. Only the
+// palette, whose 32 bytes are mirrored at a finer grain than a page, is
+// special cased.
+//
+// The pattern tables are also kept decoded, one byte per pixel (see
+// decode_tiles()), with a second set of page pointers into the decoded
+// tiles, so the renderer can copy whole rows of pixels. CHR-ROM is decoded
+// once in load_chr(). CHR-RAM rows are decoded again whenever they are
+// written to, so the decoded tiles never need to be checked for staleness.
 class vram_controller {
  public:
+  static constexpr std::size_t page_size = 0x400;
+  static constexpr std::uint16_t pattern_tables_size = 0x2000;
+  static constexpr std::uint16_t palette_start = 0x3F00;
+
+  vram_controller() {
+    load_chr(byte_span{});
+    set_mirroring(mirroring::four_screen);
+  }
+
+  // The page tables point into this
+  vram_controller(const vram_controller&) = delete;
+  vram_controller& operator=(const vram_controller&) = delete;
+
+  // Uses chr as the CHR-ROM that the pattern tables are banked from, in
+  // place. Without CHR-ROM the pattern tables are 8 KiB of CHR-RAM instead.
+  // Either way the first 8 KiB are mapped until map_chr() says otherwise.
+  void load_chr(byte_span chr) {
+    m_chr_rom = chr;
+    if (m_chr_rom.empty()) {
+      m_decoded_chr.resize(decoded_size(sizeof(m_vram.chr_ram)));
+      decode_chr_ram();
+    } else {
+      m_decoded_chr.resize(decoded_size(m_chr_rom.size()));
+      decode_tiles(m_chr_rom.data(), m_chr_rom.size() / tile_size,
+                   m_decoded_chr.data());
+    }
+    for (std::size_t page = 0; page < chr_pages; ++page) {
+      map_chr(page, page);
+    }
+  }
+
+  // Maps 1 KiB CHR bank number bank (modulo the number of banks) at page *
+  // 1 KiB of the pattern tables
+  void map_chr(std::size_t page, std::size_t bank) noexcept {
+    if (m_chr_rom.empty()) {
+      auto offset = (bank * page_size) % sizeof(m_vram.chr_ram);
+      m_read_pages[page] = m_vram.chr_ram + offset;
+      m_write_pages[page] = m_vram.chr_ram + offset;
+      m_decoded_pages[page] = m_decoded_chr.data() + decoded_size(offset);
+    } else {
+      auto offset = (bank * page_size) % m_chr_rom.size();
+      m_read_pages[page] = m_chr_rom.data() + offset;
+      // CHR-ROM ignores writes
+      m_write_pages[page] = nullptr;
+      m_decoded_pages[page] = m_decoded_chr.data() + decoded_size(offset);
+    }
+  }
+
+  // Points the four logical nametables, and their mirrors at $3000-$3EFF,
+  // at nametable memory
+  void set_mirroring(::mirroring mode) noexcept {
+    static constexpr std::uint8_t tables[][4] = {
+        {0, 0, 1, 1},  // horizontal
+        {0, 1, 0, 1},  // vertical
+        {0, 1, 2, 3},  // four_screen
+        {0, 0, 0, 0},  // single_screen_lower
+        {1, 1, 1, 1},  // single_screen_upper
+    };
+    for (std::size_t i = 0; i < 4; ++i) {
+      auto* data = m_vram.nametables +
+                   tables[static_cast<std::size_t>(mode)][i] * page_size;
+      m_read_pages[nametable_page + i] = data;
+      m_write_pages[nametable_page + i] = data;
+      m_read_pages[nametable_page + 4 + i] = data;
+      m_write_pages[nametable_page + 4 + i] = data;
+    }
+  }
+
+  [[nodiscard]] std::uint8_t read8(std::uint16_t address) const noexcept {
+    address &= 0x3FFFU;
+    if (address >= palette_start) {
+      return m_vram.palette[palette_index(address)];
+    }
+    return m_read_pages[address >> 10U][address & 0x03FFU];
+  }
+
+  void write8(std::uint16_t address, std::uint8_t value) noexcept {
+    address &= 0x3FFFU;
+    std::uint8_t* target = nullptr;
+    if (address >= palette_start) {
+      target = &m_vram.palette[palette_index(address)];
+    } else if (auto* page = m_write_pages[address >> 10U]) {
+      target = page + (address & 0x03FFU);
+    } else {
+      return;
+    }
+    *target = value;
+    if (address < pattern_tables_size) {
+      decode_chr_ram_row(address);
+    }
+    auto offset = static_cast<std::size_t>(target - bytes());
+    m_dirty_pages |= std::uint64_t{1} << (offset >> 8U);
+  }
+
+  // Rendering fetches, straight through the page tables
+
+  // Only the nametable and offset bits (11-0) of address are used
+  [[nodiscard]] std::uint8_t nametable(unsigned address) const noexcept {
+    return m_read_pages[nametable_page + ((address >> 10U) & 0x03U)]
+                       [address & 0x03FFU];
+  }
+
+  // The 8 decoded pixels of the tile row whose low plane is at address, in
+  // $0000-$1FFF
+  [[nodiscard]] const std::uint8_t* pattern_row(
+      unsigned address) const noexcept {
+    return m_decoded_pages[address >> 10U] +
+           decoded_size(address & 0x03F0U) + (address & 0x07U) * 8;
+  }
+
+  // index is the offset from $3F00 of an entry the PPU draws with, which are
+  // never the mirrored ones
+  [[nodiscard]] std::uint8_t palette(unsigned index) const noexcept {
+    return m_vram.palette[index];
+  }
+
+  void save(vram_state& state) const noexcept {
+    std::memcpy(&state, &m_vram, sizeof(m_vram));
+  }
+
+  // Only restores memory contents, the page tables stay as they are.
+  // Everything counts as dirty afterwards.
+  void load(const vram_state& state) noexcept {
+    std::memcpy(&m_vram, &state, sizeof(m_vram));
+    m_dirty_pages = ~std::uint64_t{0};
+    if (m_chr_rom.empty()) {
+      decode_chr_ram();
+    }
+  }
+
+  // Which 256 byte pages of vram_state were written to since the last call,
+  // one bit per page
+  [[nodiscard]] constexpr std::uint64_t take_dirty_pages() noexcept {
+    auto dirty = m_dirty_pages;
+    m_dirty_pages = 0;
+    return dirty;
+  }
 
  private:
-  std::uint8_t m_memory[0x4000];
+  static constexpr std::size_t chr_pages = pattern_tables_size / page_size;
+  static constexpr std::size_t nametable_page = chr_pages;
+  static constexpr std::size_t page_count = 0x4000 / page_size;
+  static constexpr std::size_t tile_size = 16;
+  static_assert(sizeof(vram_state) <= 64 * 0x100,
+                "dirty pages are tracked in 64 bits");
+
+  // $3F10/$3F14/$3F18/$3F1C are the same bytes as $3F00/$3F04/...
+  [[nodiscard]] static constexpr unsigned palette_index(
+      unsigned address) noexcept {
+    address &= 0x1FU;
+    return (address & 0x13U) == 0x10U ? address & 0x0FU : address;
+  }
+
+  // Size of the decoded form of chr_size bytes of CHR data
+  [[nodiscard]] static constexpr std::size_t decoded_size(
+      std::size_t chr_size) noexcept {
+    return chr_size / tile_size * decoded_tile_size;
+  }
+
+  void decode_chr_ram() noexcept {
+    decode_tiles(m_vram.chr_ram, sizeof(m_vram.chr_ram) / tile_size,
+                 m_decoded_chr.data());
+  }
+
+  // Decodes the row of CHR-RAM that the byte mapped at address is part of
+  void decode_chr_ram_row(std::uint16_t address) noexcept {
+    const auto* page = m_write_pages[address >> 10U];
+    auto offset = static_cast<std::size_t>(page - m_vram.chr_ram) +
+                  (address & 0x03F7U);
+    auto* out = m_decoded_chr.data() + decoded_size(offset) +
+                (offset & 0x07U) * 8;
+    decode_tile_row(m_vram.chr_ram[offset], m_vram.chr_ram[offset + 8], 0,
+                    out);
+  }
+
+  [[nodiscard]] std::uint8_t* bytes() noexcept {
+    return reinterpret_cast<std::uint8_t*>(&m_vram);
+  }
+
+  // Host memory backing each 1 KiB page, $3000-$3FFF mirrors the
+  // nametables. Pages without write pointers ignore writes.
+  const std::uint8_t* m_read_pages[page_count]{};
+  std::uint8_t* m_write_pages[page_count]{};
+  byte_span m_chr_rom;
+  // Decoded CHR-ROM or CHR-RAM, and the pattern table pages within it
+  std::vector<std::uint8_t> m_decoded_chr;
+  const std::uint8_t* m_decoded_pages[chr_pages]{};
+  vram_state m_vram{};
+  std::uint64_t m_dirty_pages{~std::uint64_t{0}};
 };
 
 #endif  // NES_VRAM_CONTROLLER_H